@@ -23,32 +23,113 @@ Resource -- Mcu --	|ApplyQueue			
 */
 namespace ZkClient
 {
+	class NodeValueView;
+
+	/*
+		лʽ
+		SerializeV1		key\0value\0... ɸʽvalueвܺ'\0'
+		SerializeV2		汾ͷͳǰ׺valueǶ
+		лԶʶʽ¾ɰ汾Իϲ
+	*/
+	typedef enum EmSerializeVersion{ SerializeV1 = 1, SerializeV2 = 2 }SerializeVersion;
+
 	class ZKCLIENT_API NodeValue{
 	public:
 		static NodeValue* Create();
 		static void Destory( NodeValue* value );
 	public:
+		// GetKey/GetValueصָ޸NodeValue֮ʧЧ
+		// constӿڲдκݣ߳̿ͬʱȡͬһNodeValueȡڼ䲻޸ģ
 		unsigned GetCount() const;
-		const char* GetKey( unsigned index );
-		const char* GetValue( unsigned index );
-		const char* GetValue( const char* key );	
+		const char* GetKey( unsigned index ) const;
+		const char* GetValue( unsigned index ) const;
+		const char* GetValue( const char* key ) const;	
+		// ȡvalue䳤ȣvalueΪʱʹã
+		const char* GetValue( const char* key, unsigned& value_len ) const;
+		unsigned GetValueLength( unsigned index ) const;
 		void AddValue( const char* key, const char* value );
+		// ӶvalueԺ'\0'лʱʹSerializeV2
+		void AddValue( const char* key, const char* value, unsigned value_len );
+		// ֵֶΣSerializeV2ԭʽ洢ʱͬʱıGetValueSerializeV1ʹã
+		// ֶַεGetInt64/GetDoubleʱstrtoll/strtodַfalse
+		void SetInt64( const char* key, long long value );
+		void SetDouble( const char* key, double value );
+		bool GetInt64( const char* key, long long& value ) const;
+		bool GetDouble( const char* key, double& value ) const;
 		void DeleteAll();
+		// ָƣ64λɢУлʽ޹أͬʱָͬ
+		// ޸ֶʱ£ȡʱҪ㣬ظĸ
+		unsigned long long GetFingerprint() const;
 		bool DeleteValue( const char* key );
 	public:
 		void DeSerialize( const char* buff, int len );
-		bool Serialize( char* buff, int& len );
-		NodeValue* Clone();
+		// ʹĬϸʽлжvalueʱʹSerializeV2
+		bool Serialize( char* buff, int& len ) const;
+		// ʹָʽлSerializeV1޷ʾvalueʱfalse
+		bool Serialize( char* buff, int& len, int version ) const;
+		// ȡлĻȣĬϸʽ/ָʽ
+		int GetSerializedSize() const;
+		int GetSerializedSize( int version ) const;
+		// Ĭлʽжȡ֮лΪSerializeV2ĬSerializeV1
+		static void SetDefaultVersion( int version );
+		NodeValue* Clone() const;
+		// ͼ滻ǰݣֻһԭʼ
+		void Assign( const NodeValueView* view );
+		// ߵݣ
+		void Swap( NodeValue* value );
+		// ӹvalueݣvalueͷţúʹ
+		void Adopt( NodeValue* value );
+		// 뵱ǰݵ¶󣨲ݣκһ޸ʱŻḴ
+		// ڱصеNodeValueʹʱDestory
+		NodeValue* Detach();
 	private:
+		class NodeValueImpl;
 		NodeValue();
+		NodeValue( NodeValueImpl* impl );
 		~NodeValue();
-		class NodeValueImpl;
+		friend class NodeValuePool;
 		NodeValueImpl* impl_;
 	};
+
+	/*
+		ֻNodeValueͼ
+		ֱлϽƫΪÿֶηַ
+		Attach֮󻺳ʹڼ䱣ЧҪʱKeepֻһԭʼݣ
+		ͨNodeValue::Assignת
+		ȡʱỺֵıָƣһͼܱ߳ͬʱȡ
+	*/
+	class ZKCLIENT_API NodeValueView{
+	public:
+		static NodeValueView* Create();
+		static void Destory( NodeValueView* view );
+	public:
+		// buffϽݸʽ󷵻false
+		bool Attach( const char* buff, int len );
+		// ԭʼݣ֮ⲿ
+		void Keep();
+		unsigned GetCount() const;
+		const char* GetKey( unsigned index ) const;
+		const char* GetValue( unsigned index ) const;
+		const char* GetValue( const char* key ) const;
+		const char* GetValue( const char* key, unsigned& value_len ) const;
+		unsigned GetValueLength( unsigned index ) const;
+		bool GetInt64( const char* key, long long& value ) const;
+		bool GetDouble( const char* key, double& value ) const;
+		// NodeValue::GetFingerprint㷨ֱͬӱȽ
+		unsigned long long GetFingerprint() const;
+		class NodeValueViewImpl;
+	private:
+		friend class NodeValue;
+		NodeValueView();
+		~NodeValueView();
+		NodeValueViewImpl* impl_;
+	};
 	
 	#define INVALID_ID -1
 	typedef int NodeID;
 	typedef enum EmZkSystemState{ zkConnected, zkDisconnect, zkConnecting, zkReConnecting }ZkSystemState;
+	// ¼ѭʽҪġѾfd¼PollProcess
+	typedef enum EmZkPollEvent{ zkPollRead = 1, zkPollWrite = 2 }ZkPollEvent;
 
 	// ص
 	/*
@@ -68,7 +149,7 @@ namespace ZkClient
 		void* context;			
 
 		// NodeValueΪclientڲԴҪ洢
-		// Ҫ洢NodeValue::Create Ȼͨлͷл
+		// Ҫ洢NodeValue::DetachݣNodeValue::Destory
 		struct SourceChangeParam 
 		{
 			// Դб
@@ -91,7 +172,7 @@ namespace ZkClient
 
 			// ԤռϢʹҪд [out]
 			NodeValue* reserve_value;
-			// ԶɾԤռʱ䣨ʹҪд 0ʾֱɾ [out]
+			// ԶɾԤռʱ䣬λ루ʹҪд 0ʾֱɾɾ [out]
 			unsigned auto_delete_time;
 			// ѾдԤռУʹҪд [out]
 			bool has_choosed;
@@ -99,8 +180,12 @@ namespace ZkClient
 		struct ApplyAckParam{
 			// ·
 			const char* full_path;
-			// ͻΨһ
+			// ͻΨһڵţ
 			int index;
+			// Ŷλãǰ滹мߣ0Ϊף-1Ϊδ֪ڵ㴴ʱ
+			// ֻwatchǰһڵ㣬뿪»ȡбʱ²ٴλصApplyAckCb
+			// ǰ뿪ᴥ£ǹֵʵλòڸֵ
+			int position;
 		};
 		union{
 			// עص RegisterCB/ChangeCb/DeleteCbʱʹ
@@ -109,18 +194,52 @@ namespace ZkClient
 			SourceChangeParam source_change_param;
 			// Դɹص ApplySuccessCbʱʹ
 			ApplySuccessParam apply_success_param;
-			// Applyظ,Ϊʹ
+			// ApplyظŶλø,Ϊʹ
 			ApplyAckParam apply_ack_param;
 		};
 	}CallbackParam;
 
 	typedef void(*ZkCallback)( CallbackParam* param );
 
+	typedef struct TDispatchStats
+	{
+		// ߳
+		unsigned thread_count;
+		// ȴִеĻص
+		unsigned queue_depth;
+		// ȴִеĻصֵ
+		unsigned max_queue_depth;
+		// ִеĻص
+		unsigned long long dispatch_count;
+		// صӷеʼִеʱ䣨΢룩ۼֵֵ
+		unsigned long long total_latency_us;
+		unsigned long long max_latency_us;
+	}DispatchStats;
+
+	/*
+		صɷ̳߳أclientã
+		clientɷSetDispatchûصzkĻصִ߳Уǽ̣߳
+		ĻصzkصͬһclientĻص˳ִУͬclientĻصִ
+		صеݣNodeValue·ɷʱѸƣصغͷ
+	*/
+	class ZKCLIENT_API IZkDispatcher
+	{
+	public:
+		// ̣߳Ѿʱtrueı߳
+		static bool Start( unsigned thread_count = 4 );
+		// ִеĻصֹ̣֮ͣ߳صָzkĻصִ߳
+		// ֹͣclientĶ֮ǰ»صȻУ˳
+		// ȴ߳˳ɷĻصеãȴԼ
+		static void Stop();
+		static void GetStats( DispatchStats& stats );
+	};
+
 	class ZKCLIENT_API IZkRegisterClient
 	{
 	public:
 		static IZkRegisterClient* Create( ZkCallback callback, void* context = 0,
 			char* root_path = "/Resource", char* source_path = "/Source" );
+		// ȴÿͻִеĻصڻصе
 		static void Destory( IZkRegisterClient* client );	
 	public:
 		/*
@@ -145,6 +264,7 @@ namespace ZkClient
 		[in]	id RegisterصϢ  
 		[in]	value Ҫ޸ĵϢ
 		return  ZOkΪοERRORS
+		ϴдͬʱдzkֱӷZOKûChangeCbص
 		*/
 		int Change( NodeID& id, NodeValue* value );
 		/*
@@ -157,6 +277,28 @@ namespace ZkClient
 		ȡǰϵͳ״̬
 		*/
 		ZkSystemState GetSystemState();
+		/*
+		صɷĬϹرգҪȵIZkDispatcher::StartConnect֮ǰ
+		رʱȴѷеĻصִ꣬ɷĻصйرգȴԼ
+		*/
+		void SetDispatch( bool is_enable );
+		/*
+		ỰĬϹرգConnect֮ǰãҪ̵߳zookeeper⣨THREADED
+		ͬhostclientһzkỰһӡһ̺߳
+		һclientϿʱرջỰỰʱʹõһӵclienttime_outclienttime_outЧͬʱӡ棩
+		ỰʱclientϿclientϿʱɾԼʱڵ㣨Ựرգ
+		*/
+		void SetSharedSession( bool is_enable );
+		/*
+		¼ѭʽҪӵ̵߳zookeeper_st⣬ʱTHREADED
+		zkIOͻص̣߳ɵߵ¼ѭepollȣлصProcessִ
+		Connect֮ÿεȴǰPollȡҪfd¼ZkPollEventͳʱ룩
+		fdʱProcesseventsΪ¼ʱʱΪ0
+		fdʱ仯ÿζҪȡfdΪ-1ʱֻȴʱ
+		zookeeperĽ̵߳zookeeperⷵZAPIERRORDestory֮ǰҪֹͣ
+		*/
+		int Poll( int& fd, int& events, int& timeout );
+		int Process( int events );
 	public:
 		/*
 			ӡǰ״̬ĬIO
@@ -170,6 +312,25 @@ namespace ZkClient
 		~IZkRegisterClient(void);	
 	};
 
+	// ͻ˵Ļͳ
+	typedef struct TCacheStats
+	{
+		// Դڵ
+		unsigned source_count;
+		// Ԥռڵ
+		unsigned reserve_count;
+		// ڵռõڴ棨ֽڣ
+		unsigned long long value_bytes;
+		// ճеNodeValue
+		unsigned pooled_count;
+		// ճռõڴ棨ֽڣ
+		unsigned long long pooled_bytes;
+		// ԴԤռڵwatchÿڵһ
+		unsigned watch_count;
+	}CacheStats;
+
+	class SourceSnapshot;
+
 	/*
 		Ŀǰַʽʹͻ
 		1ֻconnectӿڣȻZkCallbackӿдSourceChangeCbȻֱʹԴ
@@ -186,6 +347,7 @@ namespace ZkClient
 			char* apply_queue_name = "/ApplyQueue",
 			char* reserve_queue_name = "/ReserveQueue",
 			char* source_name = "/Source");
+		// ȴÿͻִеĻصڻصе
 		static void Destory( IZkApplyClient* client );
 	public:
 		/*
@@ -196,14 +358,59 @@ namespace ZkClient
 		int Disconnect();
 		/*
 		Դ
-		[in]	볬ʱ
+		[in]	볬ʱ룩<=0ʱ
 		ҪZkCallback=ApplyInited 
+		ʱδԴʱɾڵ㣬صApplyFailCbresult=ZOPERATIONTIMEOUT֮
 		*/
 		int Apply( int time_out = 10000 );
 		/*
+		ȡڽе루ɾڵ㣩صApplyFailCb
+		ZOKûڽеʱ-1
+		*/
+		int CancelApply();
+		/*
 		ȡǰϵͳ״̬
 		*/
 		ZkSystemState GetSystemState();	
+		/*
+		NodeValueճأĬϹرգ
+		ڵɾʱNodeValueŻسУ¼ʱѷڴ
+		رʱͷųеNodeValue
+		*/
+		void SetValuePool( bool is_enable );
+		/*
+		ȡͳƣڵڴ棩
+		*/
+		void GetCacheStats( CacheStats& stats );
+		/*
+		صɷĬϹرգҪȵIZkDispatcher::StartConnect֮ǰ
+		ApplySuccessCbҲڹִ߳Уصغڸ߳дԤռڵ
+		رʱȴѷеĻصִ꣬ɷĻصйرգȴԼ
+		*/
+		void SetDispatch( bool is_enable );
+		/*
+		ȡԴؿգԴڵԤռڵ㣩ֻڼʱݼ
+		仯ʱ¿գֻƱ仯Ľڵ㣬½ڵ֮ŷȡõĿղı䣬߳ʹ
+		᷵NULLʹSourceSnapshot::Release
+		*/
+		SourceSnapshot* GetSourceSnapshot();
+		/*
+		ỰĬϹرգConnect֮ǰãҪ̵߳zookeeper⣨THREADED
+		ͬhostclientһzkỰһӡһ̺߳
+		һclientϿʱرջỰỰʱʹõһӵclienttime_outclienttime_outЧͬʱӡ棩
+		ỰʱclientϿclientϿʱɾԼʱڵ㣨Ựرգ
+		*/
+		void SetSharedSession( bool is_enable );
+		/*
+		¼ѭʽҪӵ̵߳zookeeper_st⣬ʱTHREADED
+		zkIOͻص̣߳ɵߵ¼ѭepollȣлصProcessִ
+		Connect֮ÿεȴǰPollȡҪfd¼ZkPollEventͳʱ룩
+		fdʱProcesseventsΪ¼ʱʱΪ0
+		fdʱ仯ÿζҪȡfdΪ-1ʱֻȴʱ
+		zookeeperĽ̵߳zookeeperⷵZAPIERRORDestory֮ǰҪֹͣ
+		*/
+		int Poll( int& fd, int& events, int& timeout );
+		int Process( int events );
 
 	public:
 		/*
@@ -222,6 +429,34 @@ namespace ZkClient
 			char* source_name = "/Source" );
 		~IZkApplyClient(void);
 	};
+
+	/*
+		ͻ˵Դؿգֻü
+		ڵ㰴·ԴڵֻѼݵ
+		صNodeValueֻDestoryRelease֮ǰЧ
+		ղͻˣͻɾԿʹ
+	*/
+	class ZKCLIENT_API SourceSnapshot{
+	public:
+		void AddRef();
+		// Ϊ0ʱͷſ
+		void Release();
+	public:
+		// 汾ţÿα仯1
+		unsigned long long GetVersion() const;
+		unsigned GetSourceCount() const;
+		const char* GetSourcePath( unsigned index ) const;
+		const NodeValue* GetSource( unsigned index ) const;
+		unsigned GetReserveCount() const;
+		const char* GetReservePath( unsigned index ) const;
+		const NodeValue* GetReserve( unsigned index ) const;
+		class SourceSnapshotImpl;
+	private:
+		friend class IZkApplyClient::ZkApplyClientImpl;
+		SourceSnapshot();
+		~SourceSnapshot();
+		SourceSnapshotImpl* impl_;
+	};
 	
 	typedef void (*PrintFunc)( const unsigned char id,const unsigned short lvl, const char* szUsage, ... );
 	class ZKCLIENT_API IZkLogHelp{
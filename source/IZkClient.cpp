@@ -3,10 +3,15 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <set>
 #include <memory>
+#include <algorithm>
 using namespace std;
 
 #include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
 #include "zookeeper.h"
 #include "zookeeper_log.h"
 
@@ -17,6 +22,8 @@ using namespace std;
 #include <windows.h>
 #else
 #include <unistd.h>
+#include <stdint.h>
+#include <sys/time.h>
 #endif
 
 /*****************************************************************************
@@ -30,16 +37,45 @@ using namespace std;
 				NodeValue			zkݽڵĳʵ
 
 ģ
-	1 ڽclientɾͻصҰָ
+	1 ֻбصʹ
 	2 ڽûclientӿںͻصclientӿڳֵĶ߳
 	3 ڽͻصʹʱֵĶ߳
+	4 ͻ˵Ļд޸Ļʱ2֮дѯͳֻж
+	ϵͳ״̬ΪԭӱGetSystemState
+	clientɾͻصҰָĵüصڼ䣬
+	ɾclientȴContext::Clear
+	صɷʱûصɷִ߳У2ZkDispatcher
 *****************************************************************************/
 
 namespace ZkClient
 {
 #define DEL_PTR( p ) if(p) delete p; p = NULL;
 #define DEL_PTR_ARRAY( p ) if(p) delete [] p; p = NULL;
-#define MAX_BUFF	20480
+// ԭӼӼ޸ĺֵ
+#ifdef WIN32
+#define ZK_ATOMIC_INC( p )	InterlockedIncrement( p )
+#define ZK_ATOMIC_DEC( p )	InterlockedDecrement( p )
+// Ƚϲɹtrue
+#define ZK_ATOMIC_CAS( p, old_value, new_value )	( InterlockedCompareExchange( p, new_value, old_value ) == old_value )
+#define ZK_ATOMIC_CAS_PTR( p, old_value, new_value )	\
+	( InterlockedCompareExchangePointer( (PVOID volatile*)( p ), (PVOID)( new_value ), (PVOID)( old_value ) ) == (PVOID)( old_value ) )
+// ڴϵĶд
+#define ZK_ATOMIC_LOAD( p )	InterlockedCompareExchange( p, 0, 0 )
+#define ZK_ATOMIC_STORE( p, value )	InterlockedExchange( p, value )
+#else
+#define ZK_ATOMIC_INC( p )	__sync_add_and_fetch( p, 1 )
+#define ZK_ATOMIC_DEC( p )	__sync_sub_and_fetch( p, 1 )
+#define ZK_ATOMIC_CAS( p, old_value, new_value )	__sync_bool_compare_and_swap( p, old_value, new_value )
+#define ZK_ATOMIC_CAS_PTR( p, old_value, new_value )	__sync_bool_compare_and_swap( p, old_value, new_value )
+#define ZK_ATOMIC_LOAD( p )	__sync_fetch_and_add( p, 0 )
+#define ZK_ATOMIC_STORE( p, value )	{ __sync_synchronize(); __sync_lock_test_and_set( p, value ); }
+#endif
+// лʱջϻСڶϷ
+#define STACK_BUFF	1024
+// ڵޣzookeeperjute.maxbufferĬֵ
+#define MAX_NODE_BUFF	0xfffff
+// ճеNodeValueౣڴ
+#define NODE_POOL_MAX_BYTES	0x10000
 bool is_print_open = false;
 PrintFunc Print = NULL;
 #define PRINT( print ) if ( is_print_open ) printf("[ZkClient] ");print;
@@ -88,11 +124,111 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 		pthread_mutex_t* mutex_;
 	};
 
+	// д룩
+	class ZkRwLock
+	{
+	public:
+		ZkRwLock()
+		{
+#ifdef WIN32
+			InitializeSRWLock( &lock_ );
+#else
+			pthread_rwlock_init( &lock_, NULL );
+#endif
+		}
+		~ZkRwLock()
+		{
+#ifndef WIN32
+			pthread_rwlock_destroy( &lock_ );
+#endif
+		}
+		void ReadLock()
+		{
+#ifdef WIN32
+			AcquireSRWLockShared( &lock_ );
+#else
+			pthread_rwlock_rdlock( &lock_ );
+#endif
+		}
+		void ReadUnlock()
+		{
+#ifdef WIN32
+			ReleaseSRWLockShared( &lock_ );
+#else
+			pthread_rwlock_unlock( &lock_ );
+#endif
+		}
+		void WriteLock()
+		{
+#ifdef WIN32
+			AcquireSRWLockExclusive( &lock_ );
+#else
+			pthread_rwlock_wrlock( &lock_ );
+#endif
+		}
+		void WriteUnlock()
+		{
+#ifdef WIN32
+			ReleaseSRWLockExclusive( &lock_ );
+#else
+			pthread_rwlock_unlock( &lock_ );
+#endif
+		}
+	private:
+		ZkRwLock( const ZkRwLock& );
+		ZkRwLock& operator=( const ZkRwLock& );
+#ifdef WIN32
+		SRWLOCK lock_;
+#else
+		pthread_rwlock_t lock_;
+#endif
+	};
+
+	class ZkAutoReadLock
+	{
+	public:
+		ZkAutoReadLock( ZkRwLock* lock ):lock_( lock ){ lock_->ReadLock(); }
+		~ZkAutoReadLock(){ lock_->ReadUnlock(); }
+	private:
+		ZkRwLock* lock_;
+	};
+
+	class ZkAutoWriteLock
+	{
+	public:
+		ZkAutoWriteLock( ZkRwLock* lock ):lock_( lock ){ lock_->WriteLock(); }
+		~ZkAutoWriteLock(){ lock_->WriteUnlock(); }
+	private:
+		ZkRwLock* lock_;
+	};
+
+	// ԭӶдöֵѯ
+	template< typename T >
+	class ZkAtomicValue
+	{
+	public:
+		ZkAtomicValue( T value ):value_( (long)value ){}
+		operator T() const { return Load(); }
+		ZkAtomicValue& operator=( T value ){ Store( value ); return *this; }
+		T Load() const { return (T)ZK_ATOMIC_LOAD( &value_ ); }
+		void Store( T value ){ ZK_ATOMIC_STORE( &value_, (long)value ); }
+	private:
+		ZkAtomicValue( const ZkAtomicValue& );
+		mutable volatile long value_;
+	};
+
 	// Զʼ
 	class ZkAutoInit
 	{
 	public:
-		ZkAutoInit( pthread_mutex_t* mutex ){	
+		ZkAutoInit( pthread_cond_t* cond ):mutex_(NULL),cond_(cond){
+			int ret = pthread_cond_init( cond, NULL );
+			if ( ret != 0 )
+			{
+				ZkClientPrint( ZK_LOG_LVL_ERROR, "create cond fail error=%d\n", ret );
+			}
+		}
+		ZkAutoInit( pthread_mutex_t* mutex ):cond_(NULL){	
 			// windowsĬϿ룩
 			pthread_mutexattr_t attr;
 			pthread_mutexattr_init( &attr );	
@@ -107,795 +243,3975 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 			}
 		}
 		~ZkAutoInit(){
-			pthread_mutex_destroy(mutex_);
+			if ( mutex_ != NULL )
+			{
+				pthread_mutex_destroy(mutex_);
+			}
+			if ( cond_ != NULL )
+			{
+				pthread_cond_destroy(cond_);
+			}
 		}
 	private:
 		pthread_mutex_t* mutex_;
+		pthread_cond_t* cond_;
 	};
 
-	class NodeValue::NodeValueImpl
+	/*
+		лʽ
+		v1	key\0value\0key\0value\0...
+		v2	\0 'Z' 'V' version flags [count] { field }...
+			flags&V2_FLAG_COUNTʾֶȺΪvarint
+			ֶͨ		keylen key \0 valuelen value \0
+			ֶ		keylen key \0 type { valuelen value \0 | zigzag varint | 8ֽdouble }
+			flags&V2_FLAG_TYPEDʱÿֶζtype
+			ַ'\0'v2Ҳԭvalue԰'\0'
+		ֶkey_/value_ΪַԻʼλõƫ
+		NodeValueеkey_ΪKeyDictionaryеIDFIELD_KEY_LOCALʱΪarena_еƫƣ
+	*/
+#define V2_HEADER_LEN	5
+#define V2_FLAG_COUNT	0x01
+#define V2_FLAG_TYPED	0x02
+
+	// ֶ
+#define FIELD_STRING	0
+#define FIELD_INT64		1
+#define FIELD_DOUBLE	2
+	// ֶα־
+#define FIELD_HAS_TEXT		0x01	// ıʽ
+#define FIELD_HAS_INT		0x02	// ֶַѻ
+#define FIELD_HAS_DOUBLE	0x04	// ֶַѻ渡
+#define FIELD_TEXT_EXT		0x08	// ıݻУͼֵֶΣ
+#define FIELD_KEY_LOCAL		0x10	// keyûмֵ䣬arena_
+	// ֵֶԤıռ䣬ֵתıʱԭд룬ڴ·
+#define FIELD_TEXT_SLOT		32
+
+#ifdef WIN32
+#define ZK_STRTOLL	_strtoi64
+#define ZK_MEMORY_BARRIER()	MemoryBarrier()
+#else
+#define ZK_STRTOLL	strtoll
+#define ZK_MEMORY_BARRIER()	__sync_synchronize()
+#endif
+
+	// keyֵkeyڸԵNodeValue
+#define KEY_DICT_MAX_KEYS	16384
+	// ɢв2ݣװʲһ
+#define KEY_DICT_SLOTS		32768
+#define INVALID_KEY_ID		0
+
+	struct FieldEntry
 	{
-	public:
-		unsigned GetCount() const;
-		const char* GetKey( unsigned index );
-		const char* GetValue( unsigned index );
-		const char* GetValue( const char* key );	
-		void AddValue( const char* key, const char* value );
-		void DeleteAll();
-		bool DeleteValue( const char* key );
-	public:
-		void DeSerialize( const char* buff, int len );
-		bool Serialize( char* buff, int& len );
-		NodeValue* Clone();
-	private:
-		typedef std::map<std::string,std::string> Values;
-		Values value_;
+		unsigned key_;
+		unsigned key_len_;
+		unsigned value_;
+		unsigned value_len_;
+		unsigned char type_;
+		unsigned char flags_;
+		// ֵֶεֵֶַεĽ
+		union
+		{
+			long long int_;
+			double double_;
+		}number_;
 	};
+	typedef std::vector<FieldEntry> FieldEntries;
 
-	NodeValue* NodeValue::Create()
-	{
-		return new NodeValue();
-	}
-	void NodeValue::Destory( NodeValue* value )
-	{
-		DEL_PTR(value);
-	}
-	NodeValue::NodeValue()
-	{
-		impl_ = new NodeValueImpl();
-	}
-	NodeValue::~NodeValue()
-	{
-		DEL_PTR(impl_)
-	}
-	unsigned NodeValue::GetCount() const
-	{
-		return impl_->GetCount();
-	}
-	const char* NodeValue::GetKey( unsigned index )
+	// ν'\0'λãkey/valueԳֶΣv1ʽ
+	class FieldScanner
 	{
-		return impl_->GetKey(index);
-	}
-	const char* NodeValue::GetValue( unsigned index )
-	{
-		return impl_->GetValue(index);
-	}
-	const char* NodeValue::GetValue( const char* key )
-	{
-		return impl_->GetValue(key);
-	}
-	void NodeValue::AddValue( const char* key, const char* value )
-	{
-		impl_->AddValue( key, value );
-	}
-	void NodeValue::DeleteAll()
-	{
-		impl_->DeleteAll();
-	}
-	bool NodeValue::DeleteValue( const char* key )
-	{
-		return impl_->DeleteValue(key);
-	}
-	void NodeValue::DeSerialize( const char* buff, int len )
-	{
-		impl_->DeSerialize( buff, len );
-	}
-	bool NodeValue::Serialize( char* buff, int& len )
-	{
-		return impl_->Serialize( buff, len );
-	}
-	NodeValue* NodeValue::Clone()
-	{
-		return impl_->Clone();
-	}
+	public:
+		FieldScanner( const char* buff, unsigned len, FieldEntries& entries )
+			:buff_(buff),len_(len),entries_(entries),start_(0),is_key_(true),is_sorted_(true)
+		{
+			entry_.type_ = FIELD_STRING;
+			entry_.flags_ = FIELD_HAS_TEXT;
+		}
+		// falseʾֶѾҪ
+		bool OnNul( unsigned pos );
+		bool IsComplete() const{ return is_key_ && start_ >= len_; }
+		bool IsSorted() const{ return is_sorted_; }
+	private:
+		const char* buff_;
+		unsigned len_;
+		FieldEntries& entries_;
+		FieldEntry entry_;
+		unsigned start_;
+		bool is_key_;
+		bool is_sorted_;
+	};
 
-	unsigned NodeValue::NodeValueImpl::GetCount() const
+	// NodeValueNodeValueViewõ㷨
+	class FieldIndex
 	{
-		return value_.size();
-	}
+	public:
+		// std::stringıȽϹһ
+		static int CompareKey( const char* left, unsigned left_len, const char* right, unsigned right_len );
+		// ΪbuffkeyȥصͬkeyֵΪ׼
+		// lenΪݳȣsizeΪɶȣֶû'\0'βʱfalse
+		// garbageرȥضֽ
+		static bool Build( const char* buff, unsigned len, unsigned size, FieldEntries& entries, unsigned& garbage );
+		// Ϊv2ʽbuffݲԽ緵false
+		// ֵֶûıռ䣬ҪΪ
+		static bool BuildV2( const char* buff, unsigned len, FieldEntries& entries, unsigned& garbage );
+		// ʶݸʽSerializeV1/SerializeV2
+		static int GetVersion( const char* buff, unsigned len );
+		// ֲңصһkeyСĿλ
+		static unsigned LowerBound( const char* base, const FieldEntries& entries, const char* key, unsigned key_len, bool& is_find );
+
+		static unsigned GetVarintSize( unsigned long long value );
+		static unsigned WriteVarint( char* buff, unsigned long long value );
+		static bool ReadVarint( const char* buff, unsigned len, unsigned& pos, unsigned& value );
+		static bool ReadVarint( const char* buff, unsigned len, unsigned& pos, unsigned long long& value );
+
+		// ֵֶεıһηʱдtextFIELD_TEXT_SLOTС
+		static const char* GetText( FieldEntry& entry, char* text );
+		// ȡֵֶַΰstrtoll/strtodis_cacheʱ
+		static bool GetInt64( FieldEntry& entry, const char* base, long long& value, bool is_cache );
+		static bool GetDouble( FieldEntry& entry, const char* base, double& value, bool is_cache );
+		static unsigned GetNumberCount( const FieldEntries& entries );
+
+		// ָƣֶεɢкӣֶ˳лʽ޹أ޸ĵֶʱ
+		static unsigned long long HashBytes( unsigned long long hash, const char* data, unsigned len );
+		static unsigned long long HashField( const char* key, const FieldEntry& entry, const char* value );
+	private:
+		// ȥأis_sortedΪtrueʱֱӷ
+		static void Sort( const char* buff, bool is_sorted, FieldEntries& entries, unsigned& garbage );
+		// buff[0, size)в'\0'scanner
+		// ʹmemchrCѰCPUѡʵֶ֣γʱԼSSE2/AVX2ѭ죬ֶζʱ
+		static void Scan( const char* buff, unsigned size, FieldScanner& scanner );
+		struct EntryLess
+		{
+			EntryLess( const char* base ):base_(base){}
+			bool operator()( const FieldEntry& left, const FieldEntry& right ) const
+			{
+				return CompareKey( base_ + left.key_, left.key_len_, base_ + right.key_, right.key_len_ ) < 0;
+			}
+			const char* base_;
+		};
+	};
 
-	const char* NodeValue::NodeValueImpl::GetKey( unsigned index )
+	int FieldIndex::CompareKey( const char* left, unsigned left_len, const char* right, unsigned right_len )
 	{
-		if ( index >= value_.size() )
+		int ret = memcmp( left, right, left_len < right_len ? left_len : right_len );
+		if ( ret != 0 )
 		{
-			return NULL;
+			return ret;
 		}
-		Values::iterator itr = value_.begin();
-		unsigned temp = index;
-		while ( temp > 0 )
+		if ( left_len == right_len )
 		{
-			itr++;
-			temp--;
+			return 0;
 		}
-		return itr->first.c_str();
+		return left_len < right_len ? -1 : 1;
 	}
 
-	const char* NodeValue::NodeValueImpl::GetValue( unsigned index )
+	bool FieldScanner::OnNul( unsigned pos )
 	{
-		if ( index >= value_.size() )
+		if ( is_key_ )
 		{
-			return NULL;
+			entry_.key_ = start_;
+			entry_.key_len_ = pos - start_;
+			is_key_ = false;
 		}
-		Values::iterator itr = value_.begin();
-		unsigned temp = index;
-		while ( temp > 0 )
+		else
 		{
-			itr++;
-			temp--;
+			entry_.value_ = start_;
+			entry_.value_len_ = pos - start_;
+			is_key_ = true;
+			if ( is_sorted_ && !entries_.empty() )
+			{
+				const FieldEntry& last = entries_.back();
+				is_sorted_ = FieldIndex::CompareKey( buff_ + last.key_, last.key_len_, buff_ + entry_.key_, entry_.key_len_ ) < 0;
+			}
+			entries_.push_back( entry_ );
 		}
-		return itr->second.c_str();
+		start_ = pos + 1;
+		return !IsComplete();
 	}
 
-	const char* NodeValue::NodeValueImpl::GetValue( const char* key )
+	void FieldIndex::Scan( const char* buff, unsigned size, FieldScanner& scanner )
 	{
-		Values::iterator itr = value_.find( key );
-		if ( itr != value_.end() )
+		unsigned pos = 0;
+		while ( pos < size )
 		{
-			return itr->second.c_str();
+			const char* end = (const char*)memchr( buff + pos, '\0', size - pos );
+			if ( end == NULL || !scanner.OnNul( end - buff ) )
+			{
+				return;
+			}
+			pos = end - buff + 1;
 		}
-		return NULL;
 	}
 
-	void NodeValue::NodeValueImpl::AddValue( const char* key, const char* value )
+	bool FieldIndex::Build( const char* buff, unsigned len, unsigned size, FieldEntries& entries, unsigned& garbage )
 	{
-		value_[key] = value;
-	}
+		entries.clear();
+		garbage = 0;
 
-	void NodeValue::NodeValueImpl::DeleteAll()
-	{
-		value_.clear();
+		// һαҳֶα߽
+		FieldScanner scanner( buff, len, entries );
+		if ( !scanner.IsComplete() )
+		{
+			Scan( buff, size, scanner );
+		}
+		if ( !scanner.IsComplete() )
+		{
+			return false;
+		}
+
+		Sort( buff, scanner.IsSorted(), entries, garbage );
+		return true;
 	}
 
-	bool NodeValue::NodeValueImpl::DeleteValue( const char* key )
+	bool FieldIndex::BuildV2( const char* buff, unsigned len, FieldEntries& entries, unsigned& garbage )
 	{
-		Values::iterator itr = value_.begin();
-		while ( itr != value_.end() )
+		entries.clear();
+		garbage = 0;
+		if ( GetVersion( buff, len ) != SerializeV2 )
+		{
+			return false;
+		}
+
+		unsigned pos = V2_HEADER_LEN;
+		unsigned count = 0;
+		char flags = buff[V2_HEADER_LEN - 1];
+		bool has_count = ( flags & V2_FLAG_COUNT ) != 0;
+		bool is_typed = ( flags & V2_FLAG_TYPED ) != 0;
+		if ( has_count )
 		{
-			if ( itr->first == key )
+			if ( !ReadVarint( buff, len, pos, count ) || count > len - pos )
 			{
-				value_.erase( itr );
-				return true;
+				return false;
 			}
-			itr++;
+			entries.reserve( count );
 		}
-		return false;
-	}
 
-	void NodeValue::NodeValueImpl::DeSerialize( const char* buff, int len )
-	{	
-		if ( len != -1 )
+		unsigned data_len = 0;
+		bool is_sorted = true;
+		while ( pos < len )
 		{
-			int str_len = 0;
-			while ( len - str_len > 0 )
+			FieldEntry entry;
+			entry.type_ = FIELD_STRING;
+			entry.flags_ = FIELD_HAS_TEXT;
+			entry.value_ = 0;
+			entry.value_len_ = 0;
+			if ( !ReadVarint( buff, len, pos, entry.key_len_ ) || entry.key_len_ >= len - pos || buff[pos + entry.key_len_] != '\0' )
+			{
+				return false;
+			}
+			entry.key_ = pos;
+			pos += entry.key_len_ + 1;
+			data_len += entry.key_len_ + 1;
+
+			if ( is_typed )
 			{
-				string key = buff + str_len;
-				str_len += key.length() + 1;
+				if ( pos >= len )
+				{
+					return false;
+				}
+				entry.type_ = (unsigned char)buff[pos++];
+			}
 
-				string value = buff + str_len;
-				str_len += value.length() + 1;
+			if ( entry.type_ == FIELD_STRING )
+			{
+				if ( !ReadVarint( buff, len, pos, entry.value_len_ ) || entry.value_len_ >= len - pos || buff[pos + entry.value_len_] != '\0' )
+				{
+					return false;
+				}
+				entry.value_ = pos;
+				pos += entry.value_len_ + 1;
+				data_len += entry.value_len_ + 1;
+			}
+			else if ( entry.type_ == FIELD_INT64 )
+			{
+				unsigned long long zigzag = 0;
+				if ( !ReadVarint( buff, len, pos, zigzag ) )
+				{
+					return false;
+				}
+				entry.flags_ = 0;
+				entry.number_.int_ = (long long)( zigzag >> 1 ) ^ -(long long)( zigzag & 1 );
+			}
+			else if ( entry.type_ == FIELD_DOUBLE )
+			{
+				if ( len - pos < 8 )
+				{
+					return false;
+				}
+				unsigned long long bits = 0;
+				for ( int i = 7; i >= 0; i-- )
+				{
+					bits = ( bits << 8 ) | (unsigned char)buff[pos + i];
+				}
+				pos += 8;
+				entry.flags_ = 0;
+				memcpy( &entry.number_.double_, &bits, sizeof(bits) );
+			}
+			else
+			{
+				// δ֪޷ȷ
+				return false;
+			}
 
-				value_[key] = value;
+			if ( is_sorted && !entries.empty() )
+			{
+				const FieldEntry& last = entries.back();
+				is_sorted = CompareKey( buff + last.key_, last.key_len_, buff + entry.key_, entry.key_len_ ) < 0;
 			}
+			entries.push_back( entry );
 		}
+		if ( has_count && count != entries.size() )
+		{
+			return false;
+		}
+
+		// ͷȺֵֶԭʱʹõĿռ
+		garbage = len - data_len;
+		Sort( buff, is_sorted, entries, garbage );
+		return true;
 	}
 
-	bool NodeValue::NodeValueImpl::Serialize( char* buff, int& len )
+	void FieldIndex::Sort( const char* buff, bool is_sorted, FieldEntries& entries, unsigned& garbage )
 	{
-		Values::iterator itr = value_.begin();
-		unsigned buffer_len = 0;
-		while ( itr != value_.end() )
-		{	
-			int str_len = itr->first.length() + 1;
-			if ( buffer_len + str_len > len )
+		// SerializeģֻⲿдݲҪȥ
+		if ( is_sorted )
+		{
+			return;
+		}
+		std::stable_sort( entries.begin(), entries.end(), EntryLess( buff ) );
+		unsigned count = 0;
+		for ( unsigned i = 0; i < entries.size(); i++ )
+		{
+			if ( count > 0 && !EntryLess( buff )( entries[count - 1], entries[i] ) )
 			{
-				return false;
+				garbage += entries[count - 1].key_len_ + entries[count - 1].value_len_ + 2;
+				entries[count - 1] = entries[i];
 			}
-			memcpy( buff + buffer_len, itr->first.c_str(), str_len );
-			buffer_len += str_len;
-
-			str_len = itr->second.length() + 1;
-			if ( buffer_len + str_len > len )
+			else
 			{
-				return false;
+				entries[count++] = entries[i];
 			}
-			memcpy( buff + buffer_len, itr->second.c_str(), str_len );
-			buffer_len += str_len;
-			itr++;
 		}
-		len = buffer_len;
-		return true;
+		entries.resize( count );
 	}
 
-	NodeValue* NodeValue::NodeValueImpl::Clone()
+	int FieldIndex::GetVersion( const char* buff, unsigned len )
 	{
-		NodeValue* value = NodeValue::Create();
-		Values::iterator itr = value_.begin();
-		while ( itr != value_.end() )
+		// v1keyͷֻеһkeyΪմʱֽڲŻ'\0'
+		if ( len >= V2_HEADER_LEN && buff[0] == '\0' && buff[1] == 'Z' && buff[2] == 'V' && buff[3] == SerializeV2 )
 		{
-			value->AddValue( itr->first.c_str(), itr->second.c_str() );
-			itr++;
+			return SerializeV2;
 		}
-		return value;
+		return SerializeV1;
 	}
 
-	typedef enum EmNodeState
+	unsigned FieldIndex::GetVarintSize( unsigned long long value )
 	{
-		emNormal = 0,
-		emNodeCreating,		
-	}NodeState;
+		unsigned size = 1;
+		while ( value >= 0x80 )
+		{
+			value >>= 7;
+			size++;
+		}
+		return size;
+	}
 
-	class NodeInfo 
+	unsigned FieldIndex::WriteVarint( char* buff, unsigned long long value )
 	{
-	public:
-		NodeInfo():path_(""),node_state_(emNodeCreating),type_(""), node_need_update_(false){
-			value_ = NodeValue::Create();
+		unsigned size = 0;
+		while ( value >= 0x80 )
+		{
+			buff[size++] = (char)( ( value & 0x7F ) | 0x80 );
+			value >>= 7;
 		}
-		~NodeInfo(){
-			NodeValue::Destory( value_ );
+		buff[size++] = (char)value;
+		return size;
+	}
+
+	bool FieldIndex::ReadVarint( const char* buff, unsigned len, unsigned& pos, unsigned& value )
+	{
+		unsigned long long value64 = 0;
+		if ( !ReadVarint( buff, len, pos, value64 ) || value64 > 0xFFFFFFFFULL )
+		{
+			return false;
 		}
-		bool IsCreated(){ return (path_ != "");}
-		const char* GetType(){ return type_.c_str(); }
-		void SetType( const char* type ){ type_ = type; }
-		const char* GetPath(){ return path_.c_str(); }
-		void SetPath( const char* path ){ path_ = path; }
-		NodeValue* GetValue(){ return value_; }
-		void SetValue( NodeValue* value )
+		value = (unsigned)value64;
+		return true;
+	}
+
+	bool FieldIndex::ReadVarint( const char* buff, unsigned len, unsigned& pos, unsigned long long& value )
+	{
+		value = 0;
+		for ( unsigned shift = 0; shift < 64; shift += 7 )
 		{
-			if ( value == value_ )
+			if ( pos >= len )
 			{
-				return;
+				return false;
 			}
-			value_->DeleteAll();
-			for ( int i = 0; i < value->GetCount(); i++ )
+			unsigned char byte = (unsigned char)buff[pos++];
+			value |= (unsigned long long)( byte & 0x7F ) << shift;
+			if ( ( byte & 0x80 ) == 0 )
 			{
-				value_->AddValue( value->GetKey(i), value->GetValue(i) );
+				return true;
 			}
 		}
-		void SetNodeState( NodeState state  ){ node_state_ = state; }
-		NodeState GetNodeState(){ return node_state_; }
-		void NodeNeedUpdate( bool update ){ node_need_update_ = update; }
-		bool IsNodeNeedUpdate(){ return node_need_update_; }
-	protected:
-		std::string path_;
-		std::string type_;
-		NodeValue* value_;
-		NodeState node_state_;
-		bool node_need_update_;
-	};
+		return false;
+	}
 
-	class Context;
-	class IZkRegisterClient::ZkRegisterClientImpl
+	unsigned FieldIndex::LowerBound( const char* base, const FieldEntries& entries, const char* key, unsigned key_len, bool& is_find )
 	{
-	public:
-		ZkRegisterClientImpl( ZkCallback callback, void* context = NULL,
-			char* root_path = "/Resource", char* source_path = "/Source", IZkRegisterClient* parent =NULL)
-			: zkhandle_(NULL), root_path_(root_path), source_path_(source_path), 
-			system_state_(zkDisconnect), 
-			callback_( callback ),
-			callback_context_(context),index_(0),
-			parent_(parent),connect_context_(NULL)
+		unsigned low = 0;
+		unsigned high = entries.size();
+		while ( low < high )
+		{
+			unsigned mid = low + ( high - low ) / 2;
+			const FieldEntry& entry = entries[mid];
+			if ( CompareKey( base + entry.key_, entry.key_len_, key, key_len ) < 0 )
 			{
-				Init( true );
+				low = mid + 1;
+			}
+			else
+			{
+				high = mid;
+			}
 		}
-		virtual ~ZkRegisterClientImpl(void){
-			RemoveAllNode();
-			DisConnect();
-			Init( false );
+		is_find = ( low < entries.size()
+			&& CompareKey( base + entries[low].key_, entries[low].key_len_, key, key_len ) == 0 );
+		return low;
+	}
+
+	const char* FieldIndex::GetText( FieldEntry& entry, char* text )
+	{
+		if ( ( entry.flags_ & FIELD_HAS_TEXT ) == 0 )
+		{
+			if ( entry.type_ == FIELD_INT64 )
+			{
+				entry.value_len_ = sprintf( text, "%lld", entry.number_.int_ );
+			}
+			else
+			{
+				// ʹö̸ʽ޷ԭԭֵʱʹ
+				entry.value_len_ = sprintf( text, "%.15g", entry.number_.double_ );
+				if ( strtod( text, NULL ) != entry.number_.double_ )
+				{
+					entry.value_len_ = sprintf( text, "%.17g", entry.number_.double_ );
+				}
+			}
+			entry.flags_ |= FIELD_HAS_TEXT;
 		}
-	public:
-		bool Connect( const char* host, int time_out = 10000 );
-		bool ReConnect( const char* host, int time_out = 10000 );
-		bool RestoreRegisteredNode();
-		int DisConnect();
+		return text;
+	}
 
-		int Register( const char* res, NodeValue* value, NodeID& id );
-		int Change( NodeID& id, NodeValue* value );
-		int Delete( NodeID& id );
-		ZkSystemState GetSystemState(){ return system_state_; }
-	protected:
-		NodeInfo* GetResInfo( NodeID id );	
-		// ϵͳWatch
-		static void Watch(zhandle_t *zh, int type, int state, const char *path,void *watcherCtx);
-		// Registerص
-		static void StringCB(int rc, const char *value, const void *data);
-		// Deleteص
-		static void DeleteCB(int rc, const void *data);
-		// Chanageص
-		static void StatCB(int rc, const struct Stat *stat, const void *data);
-	
+	bool FieldIndex::GetInt64( FieldEntry& entry, const char* base, long long& value, bool is_cache )
+	{
+		if ( entry.type_ == FIELD_INT64 )
+		{
+			value = entry.number_.int_;
+			return true;
+		}
+		if ( entry.type_ == FIELD_DOUBLE )
+		{
+			value = (long long)entry.number_.double_;
+			return true;
+		}
+		if ( ( entry.flags_ & FIELD_HAS_INT ) == 0 )
+		{
+			const char* text = base + entry.value_;
+			char* end = NULL;
+			long long number = ZK_STRTOLL( text, &end, 10 );
+			if ( end == text )
+			{
+				return false;
+			}
+			if ( !is_cache )
+			{
+				value = number;
+				return true;
+			}
+			entry.number_.int_ = number;
+			entry.flags_ = ( entry.flags_ & ~FIELD_HAS_DOUBLE ) | FIELD_HAS_INT;
+		}
+		value = entry.number_.int_;
+		return true;
+	}
 
-		void OnRegisterRsp( int rc, const char* value, NodeID id );
-		void OnChangeRsp( int rc, const char* value, NodeID id );
-		void OnDeleteRsp( int rc, const char* value, NodeID id );
+	bool FieldIndex::GetDouble( FieldEntry& entry, const char* base, double& value, bool is_cache )
+	{
+		if ( entry.type_ == FIELD_DOUBLE )
+		{
+			value = entry.number_.double_;
+			return true;
+		}
+		if ( entry.type_ == FIELD_INT64 )
+		{
+			value = (double)entry.number_.int_;
+			return true;
+		}
+		if ( ( entry.flags_ & FIELD_HAS_DOUBLE ) == 0 )
+		{
+			const char* text = base + entry.value_;
+			char* end = NULL;
+			double number = strtod( text, &end );
+			if ( end == text )
+			{
+				return false;
+			}
+			if ( !is_cache )
+			{
+				value = number;
+				return true;
+			}
+			entry.number_.double_ = number;
+			entry.flags_ = ( entry.flags_ & ~FIELD_HAS_INT ) | FIELD_HAS_DOUBLE;
+		}
+		value = entry.number_.double_;
+		return true;
+	}
 
-		void UpdateNodeInfo( NodeID id, const char* path );
-		void RemoveNodeInfo( NodeID id );
-		void RemoveAllNodeInfo();
-		
-		void OnConnected();
-		void OnConnecting();
-		void OnDisconnected();
-		void RemoveAllNode();
+	unsigned long long FieldIndex::HashBytes( unsigned long long hash, const char* data, unsigned len )
+	{
+		// MurmurHash64Aÿδ8ֽ
+		const unsigned long long m = 0xc6a4a7935bd1e995ULL;
+		const int r = 47;
+		hash ^= len * m;
+		const char* end = data + ( len & ~7U );
+		for ( ; data != end; data += 8 )
+		{
+			unsigned long long k = 0;
+			memcpy( &k, data, 8 );
+			k *= m;
+			k ^= k >> r;
+			k *= m;
+			hash ^= k;
+			hash *= m;
+		}
+		if ( ( len & 7 ) != 0 )
+		{
+			unsigned long long k = 0;
+			for ( unsigned i = 0; i < ( len & 7 ); i++ )
+			{
+				k |= (unsigned long long)(unsigned char)data[i] << ( i * 8 );
+			}
+			hash ^= k;
+			hash *= m;
+		}
+		hash ^= hash >> r;
+		hash *= m;
+		hash ^= hash >> r;
+		return hash;
+	}
+
+	unsigned long long FieldIndex::HashField( const char* key, const FieldEntry& entry, const char* value )
+	{
+		// Ϊӣһɢ
+		unsigned long long hash = HashBytes( entry.type_, key, entry.key_len_ );
+		if ( entry.type_ == FIELD_STRING )
+		{
+			return HashBytes( hash, value, entry.value_len_ );
+		}
+		// ֵֶʹԭֵıǷѾ޹
+		return HashBytes( hash, (const char*)&entry.number_, sizeof(entry.number_) );
+	}
+
+	unsigned FieldIndex::GetNumberCount( const FieldEntries& entries )
+	{
+		unsigned count = 0;
+		for ( unsigned i = 0; i < entries.size(); i++ )
+		{
+			if ( entries[i].type_ != FIELD_STRING )
+			{
+				count++;
+			}
+		}
+		return count;
+	}
+
+	/*
+		ڹkeyֵ
+		NodeValueͬkeyֻһݣNodeValueֻ¼ID
+		keyֻɾҵеkey٣Ҳʱ
+		дkeyٷɢвۣȡIDʱkeyһѾ
+	*/
+	class KeyDictionary
+	{
 	public:
-		IZkRegisterClient* GetParent(){ return parent_; }
-		bool Init( bool bInit = true );
-		void Print();
-	private:
-		pthread_mutex_t mutex_;
+		// keyIDֵʱINVALID_KEY_ID
+		static unsigned Intern( const char* key, unsigned len );
+		// keyIDڷINVALID_KEY_ID
+		static unsigned Find( const char* key, unsigned len );
+		static const char* GetKey( unsigned id ){ return items_[id].key_; }
+		static pthread_mutex_t mutex_;
 	private:
-		// zkͻ˾
-		zhandle_t* zkhandle_;
-		// Դ·
-		string source_path_;
-		// ڵ·
-		string root_path_;
+		static unsigned Hash( const char* key, unsigned len );
+		// ҵIDδҵʱslotΪɲλ
+		static unsigned Lookup( const char* key, unsigned len, unsigned hash, unsigned& slot );
+		struct KeyItem
+		{
+			char* key_;
+			unsigned len_;
+			unsigned hash_;
+		};
+		// ID1ʼ
+		static KeyItem items_[KEY_DICT_MAX_KEYS + 1];
+		static volatile unsigned slots_[KEY_DICT_SLOTS];
+		static unsigned count_;
+	};
+	KeyDictionary::KeyItem KeyDictionary::items_[KEY_DICT_MAX_KEYS + 1];
+	volatile unsigned KeyDictionary::slots_[KEY_DICT_SLOTS];
+	unsigned KeyDictionary::count_ = 0;
+	pthread_mutex_t KeyDictionary::mutex_;
+	ZkAutoInit key_dict_auto_init( &KeyDictionary::mutex_ );
 
-		ZkCallback callback_;
-		void* callback_context_;
-		ZkSystemState system_state_;
+	unsigned KeyDictionary::Hash( const char* key, unsigned len )
+	{
+		// FNV-1a
+		unsigned hash = 2166136261U;
+		for ( unsigned i = 0; i < len; i++ )
+		{
+			hash ^= (unsigned char)key[i];
+			hash *= 16777619U;
+		}
+		return hash;
+	}
 
-		// Դ
-		typedef map<NodeID,NodeInfo*> Nodes;
-		Nodes nodes_;
+	unsigned KeyDictionary::Lookup( const char* key, unsigned len, unsigned hash, unsigned& slot )
+	{
+		slot = hash & ( KEY_DICT_SLOTS - 1 );
+		while ( true )
+		{
+			unsigned id = slots_[slot];
+			if ( id == INVALID_KEY_ID )
+			{
+				return INVALID_KEY_ID;
+			}
+			const KeyItem& item = items_[id];
+			if ( item.hash_ == hash && item.len_ == len && memcmp( item.key_, key, len ) == 0 )
+			{
+				return id;
+			}
+			slot = ( slot + 1 ) & ( KEY_DICT_SLOTS - 1 );
+		}
+	}
 
-		NodeID index_;
-		IZkRegisterClient* parent_;
+	unsigned KeyDictionary::Find( const char* key, unsigned len )
+	{
+		unsigned slot = 0;
+		return Lookup( key, len, Hash( key, len ), slot );
+	}
+
+	unsigned KeyDictionary::Intern( const char* key, unsigned len )
+	{
+		unsigned hash = Hash( key, len );
+		unsigned slot = 0;
+		unsigned id = Lookup( key, len, hash, slot );
+		if ( id != INVALID_KEY_ID )
+		{
+			return id;
+		}
+
+		ZkAutoLock lock( &mutex_ );
+		// ڼѾ̲߳
+		id = Lookup( key, len, hash, slot );
+		if ( id != INVALID_KEY_ID || count_ >= KEY_DICT_MAX_KEYS )
+		{
+			return id;
+		}
+		id = ++count_;
+		KeyItem& item = items_[id];
+		item.key_ = new char[len + 1];
+		memcpy( item.key_, key, len );
+		item.key_[len] = '\0';
+		item.len_ = len;
+		item.hash_ = hash;
+		ZK_MEMORY_BARRIER();
+		slots_[slot] = id;
+		return id;
+	}
 
-		// context
-		Context* connect_context_;
+	class NodeValue::NodeValueImpl
+	{
+	public:
+		NodeValueImpl():garbage_(0),has_binary_(false),fingerprint_(0),refs_(1){}
+		unsigned GetCount() const;
+		const char* GetKey( unsigned index ) const;
+		const char* GetValue( unsigned index ) const;
+		const char* GetValue( const char* key ) const;
+		const char* GetValue( const char* key, unsigned& value_len ) const;
+		unsigned GetValueLength( unsigned index ) const;
+		void AddValue( const char* key, unsigned key_len, const char* value, unsigned value_len );
+		void SetNumber( const char* key, unsigned key_len, unsigned char type, long long int_value, double double_value );
+		bool GetInt64( const char* key, long long& value ) const;
+		bool GetDouble( const char* key, double& value ) const;
+		void DeleteAll();
+		bool DeleteValue( const char* key );
+		unsigned long long GetFingerprint() const{ return fingerprint_; }
+	public:
+		void DeSerialize( const char* buff, int len );
+		bool Serialize( char* buff, int& len, int version ) const;
+		int GetSerializedSize( int version ) const;
+		NodeValue* Clone() const;
+		// ͼ滻ǰݣһԭʼݺƫƱ
+		void Assign( const NodeValueView::NodeValueViewImpl* view );
+	public:
+		/*
+			NodeValueԹͬһݣDetach޸ǰͨUnshare
+			ֵֶεıָ޸ʱɣȡӿڣconstдκݣ
+			ݺͿеݿԱ߳ͬʱȡ
+		*/
+		void AddRef(){ ZK_ATOMIC_INC( &refs_ ); }
+		static void Release( NodeValueImpl* impl );
+		bool IsShared() const{ return refs_ > 1; }
+		// ؿ޸ĵݣis_keepΪfalseʱҪԭ
+		static NodeValueImpl* Unshare( NodeValueImpl* impl, bool is_keep );
+		// ݵѷڴ棨NODE_POOL_MAX_BYTESʱͷţ
+		void Recycle();
+		// ռõڴ棨㣩
+		unsigned long long GetMemorySize() const;
+		// δָʽʱʹõлʽȫ֣
+		static int default_version_;
+	private:
+		bool EncodeV1( char* buff, int& len ) const;
+		bool EncodeV2( char* buff, int& len ) const;
+		const FieldEntry* Find( const char* key ) const;
+		// keyֲңصһkeyСĿλ
+		unsigned LowerBound( const char* key, unsigned key_len, bool& is_find ) const;
+		const char* GetKeyString( const FieldEntry& entry ) const;
+		// ʹֵеkeyֵʱarena_
+		void SetKey( FieldEntry& entry, const char* key, unsigned key_len );
+		const char* GetText( const FieldEntry& entry ) const;
+		// ֶεָƣfingerprint_Ϊֶ֮
+		unsigned long long HashEntry( const FieldEntry& entry ) const;
+		// ֶvalueռõĿռ䣨ֵֶΪFIELD_TEXT_SLOT
+		unsigned GetValueSpace( const FieldEntry& entry ) const;
+		// ׷ַ'\0'βƫ
+		unsigned Append( const char* str, unsigned len );
+		// ׷ֵֶεıռ䣬ƫ
+		unsigned AppendSlot();
+		bool IsInArena( const char* str ) const;
+		// ռ䳬һʱarena_
+		void Compact();
+	private:
+		// ļֵԱ±O(1)keyO(log n)
+		FieldEntries entries_;
+		// valueһڴУkeyKeyDictionaryУ
+		std::vector<char> arena_;
+		// arena_Ѿʹõֽ
+		unsigned garbage_;
+		// ܺv1޷ʾĶvalueҪʹv2ʽ
+		bool has_binary_;
+		// ָƣ޸ֶʱ
+		unsigned long long fingerprint_;
+		// ݵNodeValue
+		volatile long refs_;
 	};
+	int NodeValue::NodeValueImpl::default_version_ = SerializeV1;
 
-	class IZkApplyClient::ZkApplyClientImpl
+	class NodeValueView::NodeValueViewImpl
 	{
 	public:
-		ZkApplyClientImpl(	char* res_type, 
-			ZkCallback callback,
-			void* context = NULL,
-			char* root_name = "/Resource", 
-			char* apply_queue_name = "/ApplyQueue",
-			char* reserve_queue_name = "/ReserveQueue",
-			char* source_name = "/Source",
-			IZkApplyClient* parent = NULL) 
-			: callback_(callback),
-			callback_context_(context),
-			res_type_(res_type),zkhandle_(NULL), 
-			apply_state_(idle), 
-			system_state_(zkDisconnect),
-			is_inited_(false),
-			parent_(parent),
-			connect_context_(NULL)
-		{
-			static int client_index = 0;
-			client_id_ = ++client_index;
-			source_path_ = root_name;
-			source_path_ += "/";
-			source_path_ += res_type_;
+		NodeValueViewImpl():buff_(NULL),len_(0),garbage_(0),version_(SerializeV1),fingerprint_(0),has_fingerprint_(false){}
+		bool Attach( const char* buff, int len );
+		void Keep();
+		void Reset();
+		unsigned GetCount() const{ return entries_.size(); }
+		const char* GetKey( unsigned index ) const;
+		const char* GetValue( unsigned index ) const;
+		const char* GetValue( const char* key ) const;
+		const char* GetValue( const char* key, unsigned& value_len ) const;
+		unsigned GetValueLength( unsigned index ) const;
+		bool GetInt64( const char* key, long long& value ) const;
+		bool GetDouble( const char* key, double& value ) const;
+		unsigned long long GetFingerprint() const;
+		// ֵֶεıtext_Уֱֶַָbuff_
+		const char* GetText( FieldEntry& entry ) const;
+		FieldEntry* Find( const char* key ) const;
+	public:
+		// ǰĻⲿowned_
+		const char* buff_;
+		unsigned len_;
+		// Keep֮ȱٽβʱŻеĿ
+		std::vector<char> owned_;
+		// ֵֶεıͽڶȡʱ
+		mutable FieldEntries entries_;
+		mutable std::vector<char> text_;
+		unsigned garbage_;
+		int version_;
+		mutable unsigned long long fingerprint_;
+		mutable bool has_fingerprint_;
+	};
 
-			reserve_queue_path_ = source_path_;
-			apply_queue_path_ = source_path_;
-			source_path_ += source_name;
+	NodeValue* NodeValue::Create()
+	{
+		return new NodeValue();
+	}
+	void NodeValue::Destory( NodeValue* value )
+	{
+		DEL_PTR(value);
+	}
+	NodeValue::NodeValue()
+	{
+		impl_ = new NodeValueImpl();
+	}
+	NodeValue::NodeValue( NodeValueImpl* impl )
+	{
+		impl_ = impl;
+	}
+	NodeValue::~NodeValue()
+	{
+		NodeValueImpl::Release( impl_ );
+		impl_ = NULL;
+	}
+	unsigned NodeValue::GetCount() const
+	{
+		return impl_->GetCount();
+	}
+	const char* NodeValue::GetKey( unsigned index ) const
+	{
+		return impl_->GetKey(index);
+	}
+	const char* NodeValue::GetValue( unsigned index ) const
+	{
+		return impl_->GetValue(index);
+	}
+	const char* NodeValue::GetValue( const char* key ) const
+	{
+		return impl_->GetValue(key);
+	}
+	const char* NodeValue::GetValue( const char* key, unsigned& value_len ) const
+	{
+		return impl_->GetValue( key, value_len );
+	}
+	unsigned NodeValue::GetValueLength( unsigned index ) const
+	{
+		return impl_->GetValueLength( index );
+	}
+	void NodeValue::AddValue( const char* key, const char* value )
+	{
+		if ( key != NULL && value != NULL )
+		{
+			impl_ = NodeValueImpl::Unshare( impl_, true );
+			impl_->AddValue( key, strlen( key ), value, strlen( value ) );
+		}
+	}
+	void NodeValue::AddValue( const char* key, const char* value, unsigned value_len )
+	{
+		if ( key != NULL && ( value != NULL || value_len == 0 ) )
+		{
+			impl_ = NodeValueImpl::Unshare( impl_, true );
+			impl_->AddValue( key, strlen( key ), value == NULL ? "" : value, value_len );
+		}
+	}
+	void NodeValue::SetInt64( const char* key, long long value )
+	{
+		if ( key != NULL )
+		{
+			impl_ = NodeValueImpl::Unshare( impl_, true );
+			impl_->SetNumber( key, strlen( key ), FIELD_INT64, value, 0 );
+		}
+	}
+	void NodeValue::SetDouble( const char* key, double value )
+	{
+		if ( key != NULL )
+		{
+			impl_ = NodeValueImpl::Unshare( impl_, true );
+			impl_->SetNumber( key, strlen( key ), FIELD_DOUBLE, 0, value );
+		}
+	}
+	bool NodeValue::GetInt64( const char* key, long long& value ) const
+	{
+		return impl_->GetInt64( key, value );
+	}
+	bool NodeValue::GetDouble( const char* key, double& value ) const
+	{
+		return impl_->GetDouble( key, value );
+	}
+	void NodeValue::DeleteAll()
+	{
+		impl_ = NodeValueImpl::Unshare( impl_, false );
+		impl_->DeleteAll();
+	}
+	unsigned long long NodeValue::GetFingerprint() const
+	{
+		return impl_->GetFingerprint();
+	}
+	bool NodeValue::DeleteValue( const char* key )
+	{
+		impl_ = NodeValueImpl::Unshare( impl_, true );
+		return impl_->DeleteValue(key);
+	}
+	void NodeValue::DeSerialize( const char* buff, int len )
+	{
+		if ( buff == NULL || len <= 0 )
+		{
+			return;
+		}
+		// Ϊʱ滻Ҫƹ
+		impl_ = NodeValueImpl::Unshare( impl_, impl_->GetCount() > 0 );
+		impl_->DeSerialize( buff, len );
+	}
+	bool NodeValue::Serialize( char* buff, int& len ) const
+	{
+		return impl_->Serialize( buff, len, 0 );
+	}
+	bool NodeValue::Serialize( char* buff, int& len, int version ) const
+	{
+		return impl_->Serialize( buff, len, version );
+	}
+	int NodeValue::GetSerializedSize() const
+	{
+		return impl_->GetSerializedSize( 0 );
+	}
+	int NodeValue::GetSerializedSize( int version ) const
+	{
+		return impl_->GetSerializedSize( version );
+	}
+	void NodeValue::SetDefaultVersion( int version )
+	{
+		if ( version == SerializeV1 || version == SerializeV2 )
+		{
+			NodeValueImpl::default_version_ = version;
+		}
+	}
+	NodeValue* NodeValue::Clone() const
+	{
+		return impl_->Clone();
+	}
+	void NodeValue::Assign( const NodeValueView* view )
+	{
+		if ( view != NULL )
+		{
+			impl_ = NodeValueImpl::Unshare( impl_, false );
+			impl_->Assign( view->impl_ );
+		}
+	}
+	void NodeValue::Swap( NodeValue* value )
+	{
+		if ( value != NULL )
+		{
+			NodeValueImpl* impl = impl_;
+			impl_ = value->impl_;
+			value->impl_ = impl;
+		}
+	}
+	void NodeValue::Adopt( NodeValue* value )
+	{
+		if ( value != NULL && value != this )
+		{
+			Swap( value );
+			NodeValue::Destory( value );
+		}
+	}
+	NodeValue* NodeValue::Detach()
+	{
+		impl_->AddRef();
+		return new NodeValue( impl_ );
+	}
+
+	unsigned NodeValue::NodeValueImpl::GetCount() const
+	{
+		return entries_.size();
+	}
+
+	const char* NodeValue::NodeValueImpl::GetKey( unsigned index ) const
+	{
+		if ( index >= entries_.size() )
+		{
+			return NULL;
+		}
+		return GetKeyString( entries_[index] );
+	}
+
+	const char* NodeValue::NodeValueImpl::GetValue( unsigned index ) const
+	{
+		if ( index >= entries_.size() )
+		{
+			return NULL;
+		}
+		return GetText( entries_[index] );
+	}
+
+	const char* NodeValue::NodeValueImpl::GetValue( const char* key ) const
+	{
+		const FieldEntry* entry = Find( key );
+		if ( entry != NULL )
+		{
+			return GetText( *entry );
+		}
+		return NULL;
+	}
+
+	const char* NodeValue::NodeValueImpl::GetValue( const char* key, unsigned& value_len ) const
+	{
+		value_len = 0;
+		const FieldEntry* entry = Find( key );
+		if ( entry != NULL )
+		{
+			value_len = entry->value_len_;
+			return GetText( *entry );
+		}
+		return NULL;
+	}
+
+	unsigned NodeValue::NodeValueImpl::GetValueLength( unsigned index ) const
+	{
+		if ( index >= entries_.size() )
+		{
+			return 0;
+		}
+		return entries_[index].value_len_;
+	}
+
+	bool NodeValue::NodeValueImpl::GetInt64( const char* key, long long& value ) const
+	{
+		const FieldEntry* entry = Find( key );
+		if ( entry != NULL )
+		{
+			// ͬһݿڱ̶߳ȡ
+			FieldEntry copy = *entry;
+			return FieldIndex::GetInt64( copy, &arena_[0], value, false );
+		}
+		return false;
+	}
+
+	bool NodeValue::NodeValueImpl::GetDouble( const char* key, double& value ) const
+	{
+		const FieldEntry* entry = Find( key );
+		if ( entry != NULL )
+		{
+			FieldEntry copy = *entry;
+			return FieldIndex::GetDouble( copy, &arena_[0], value, false );
+		}
+		return false;
+	}
+
+	const FieldEntry* NodeValue::NodeValueImpl::Find( const char* key ) const
+	{
+		if ( key == NULL || entries_.empty() )
+		{
+			return NULL;
+		}
+		bool is_find = false;
+		unsigned pos = LowerBound( key, strlen( key ), is_find );
+		if ( is_find )
+		{
+			return &entries_[pos];
+		}
+		return NULL;
+	}
+
+	unsigned NodeValue::NodeValueImpl::LowerBound( const char* key, unsigned key_len, bool& is_find ) const
+	{
+		// ֵûеkeyֻܴڱ
+		unsigned id = KeyDictionary::Find( key, key_len );
+		unsigned low = 0;
+		unsigned high = entries_.size();
+		is_find = false;
+		while ( low < high )
+		{
+			unsigned mid = low + ( high - low ) / 2;
+			const FieldEntry& entry = entries_[mid];
+			int ret = 0;
+			if ( id == INVALID_KEY_ID || entry.key_ != id || ( entry.flags_ & FIELD_KEY_LOCAL ) != 0 )
+			{
+				ret = FieldIndex::CompareKey( GetKeyString( entry ), entry.key_len_, key, key_len );
+			}
+			if ( ret == 0 )
+			{
+				is_find = true;
+				return mid;
+			}
+			if ( ret < 0 )
+			{
+				low = mid + 1;
+			}
+			else
+			{
+				high = mid;
+			}
+		}
+		return low;
+	}
+
+	const char* NodeValue::NodeValueImpl::GetKeyString( const FieldEntry& entry ) const
+	{
+		if ( ( entry.flags_ & FIELD_KEY_LOCAL ) != 0 )
+		{
+			return &arena_[entry.key_];
+		}
+		return KeyDictionary::GetKey( entry.key_ );
+	}
+
+	void NodeValue::NodeValueImpl::SetKey( FieldEntry& entry, const char* key, unsigned key_len )
+	{
+		entry.key_len_ = key_len;
+		entry.key_ = KeyDictionary::Intern( key, key_len );
+		if ( entry.key_ == INVALID_KEY_ID )
+		{
+			entry.key_ = Append( key, key_len );
+			entry.flags_ |= FIELD_KEY_LOCAL;
+		}
+	}
+
+	const char* NodeValue::NodeValueImpl::GetText( const FieldEntry& entry ) const
+	{
+		// ֵֶεıʱѾ
+		return &arena_[entry.value_];
+	}
+
+	unsigned long long NodeValue::NodeValueImpl::HashEntry( const FieldEntry& entry ) const
+	{
+		return FieldIndex::HashField( GetKeyString( entry ), entry, &arena_[entry.value_] );
+	}
+
+	unsigned NodeValue::NodeValueImpl::GetValueSpace( const FieldEntry& entry ) const
+	{
+		if ( entry.type_ != FIELD_STRING )
+		{
+			return FIELD_TEXT_SLOT;
+		}
+		return entry.value_len_ + 1;
+	}
+
+	void NodeValue::NodeValueImpl::AddValue( const char* key, unsigned key_len, const char* value, unsigned value_len )
+	{
+		// ָarena_׷ʱڴ·䣬ȿ
+		if ( IsInArena( key ) || IsInArena( value ) )
+		{
+			string key_copy( key, key_len );
+			string value_copy( value, value_len );
+			AddValue( key_copy.c_str(), key_len, value_copy.c_str(), value_len );
+			return;
+		}
+		if ( !has_binary_ && memchr( value, '\0', value_len ) != NULL )
+		{
+			has_binary_ = true;
+		}
+
+		bool is_find = false;
+		unsigned pos = LowerBound( key, key_len, is_find );
+		if ( is_find )
+		{
+			FieldEntry& entry = entries_[pos];
+			fingerprint_ -= HashEntry( entry );
+			unsigned space = GetValueSpace( entry );
+			if ( value_len < space )
+			{
+				// ֵŵ£ԭظ
+				memcpy( &arena_[entry.value_], value, value_len );
+				arena_[entry.value_ + value_len] = '\0';
+				garbage_ += space - value_len - 1;
+			}
+			else
+			{
+				garbage_ += space;
+				entry.value_ = Append( value, value_len );
+			}
+			entry.type_ = FIELD_STRING;
+			entry.flags_ = ( entry.flags_ & FIELD_KEY_LOCAL ) | FIELD_HAS_TEXT;
+			entry.value_len_ = value_len;
+			fingerprint_ += HashEntry( entry );
+			Compact();
+			return;
+		}
+
+		FieldEntry entry;
+		entry.type_ = FIELD_STRING;
+		entry.flags_ = FIELD_HAS_TEXT;
+		SetKey( entry, key, key_len );
+		entry.value_ = Append( value, value_len );
+		entry.value_len_ = value_len;
+		fingerprint_ += HashEntry( entry );
+		entries_.insert( entries_.begin() + pos, entry );
+	}
+
+	void NodeValue::NodeValueImpl::SetNumber( const char* key, unsigned key_len, unsigned char type, long long int_value, double double_value )
+	{
+		if ( IsInArena( key ) )
+		{
+			string key_copy( key, key_len );
+			SetNumber( key_copy.c_str(), key_len, type, int_value, double_value );
+			return;
+		}
+
+		bool is_find = false;
+		unsigned pos = LowerBound( key, key_len, is_find );
+		if ( !is_find )
+		{
+			FieldEntry entry;
+			entry.flags_ = 0;
+			SetKey( entry, key, key_len );
+			entry.value_ = AppendSlot();
+			entries_.insert( entries_.begin() + pos, entry );
+		}
+		else
+		{
+			fingerprint_ -= HashEntry( entries_[pos] );
+			unsigned space = GetValueSpace( entries_[pos] );
+			if ( space < FIELD_TEXT_SLOT )
+			{
+				garbage_ += space;
+				unsigned slot = AppendSlot();
+				entries_[pos].value_ = slot;
+			}
+			else
+			{
+				// ԭпռ㹻ıֱӸ
+				garbage_ += space - FIELD_TEXT_SLOT;
+			}
+		}
+
+		FieldEntry& entry = entries_[pos];
+		entry.type_ = type;
+		entry.flags_ &= FIELD_KEY_LOCAL;
+		entry.value_len_ = 0;
+		if ( type == FIELD_INT64 )
+		{
+			entry.number_.int_ = int_value;
+		}
+		else
+		{
+			entry.number_.double_ = double_value;
+		}
+		// ʱıȡʱд
+		FieldIndex::GetText( entry, &arena_[entry.value_] );
+		fingerprint_ += HashEntry( entry );
+		Compact();
+	}
+
+	void NodeValue::NodeValueImpl::DeleteAll()
+	{
+		entries_.clear();
+		arena_.clear();
+		garbage_ = 0;
+		has_binary_ = false;
+		fingerprint_ = 0;
+	}
+
+	bool NodeValue::NodeValueImpl::DeleteValue( const char* key )
+	{
+		if ( key == NULL || entries_.empty() )
+		{
+			return false;
+		}
+		bool is_find = false;
+		unsigned pos = LowerBound( key, strlen( key ), is_find );
+		if ( !is_find )
+		{
+			return false;
+		}
+		fingerprint_ -= HashEntry( entries_[pos] );
+		if ( ( entries_[pos].flags_ & FIELD_KEY_LOCAL ) != 0 )
+		{
+			garbage_ += entries_[pos].key_len_ + 1;
+		}
+		garbage_ += GetValueSpace( entries_[pos] );
+		entries_.erase( entries_.begin() + pos );
+		Compact();
+		return true;
+	}
+
+	void NodeValue::NodeValueImpl::DeSerialize( const char* buff, int len )
+	{
+		if ( buff == NULL || len <= 0 )
+		{
+			return;
+		}
+		NodeValueView::NodeValueViewImpl view;
+		if ( !view.Attach( buff, len ) )
+		{
+			ZkClientPrint( ZK_LOG_LVL_WARNING, "DeSerialize data is invalid len=%d\n", len );
+			return;
+		}
+		if ( entries_.empty() )
+		{
+			// Ϊʱֱ滻keyֵ䣬arena_ֻvalue
+			Assign( &view );
+			return;
+		}
+		// ʱԭϲͬkeyǣ
+		for ( unsigned i = 0; i < view.GetCount(); i++ )
+		{
+			const FieldEntry& entry = view.entries_[i];
+			if ( entry.type_ == FIELD_STRING )
+			{
+				AddValue( view.buff_ + entry.key_, entry.key_len_, view.buff_ + entry.value_, entry.value_len_ );
+			}
+			else
+			{
+				SetNumber( view.buff_ + entry.key_, entry.key_len_, entry.type_, entry.number_.int_, entry.number_.double_ );
+			}
+		}
+	}
+
+	void NodeValue::NodeValueImpl::Assign( const NodeValueView::NodeValueViewImpl* view )
+	{
+		DeleteAll();
+		if ( view->buff_ == NULL || view->entries_.empty() )
+		{
+			return;
+		}
+		unsigned value_size = 0;
+		for ( unsigned i = 0; i < view->entries_.size(); i++ )
+		{
+			value_size += GetValueSpace( view->entries_[i] );
+		}
+		arena_.reserve( value_size );
+		entries_.resize( view->entries_.size() );
+		for ( unsigned i = 0; i < entries_.size(); i++ )
+		{
+			const FieldEntry& source = view->entries_[i];
+			FieldEntry& entry = entries_[i];
+			entry = source;
+			entry.flags_ &= ~FIELD_TEXT_EXT;
+			SetKey( entry, view->buff_ + source.key_, source.key_len_ );
+			if ( source.type_ == FIELD_STRING )
+			{
+				entry.value_ = Append( view->buff_ + source.value_, source.value_len_ );
+			}
+			else
+			{
+				// ͼֵֶεıtext_Уûʱ
+				entry.value_ = AppendSlot();
+				if ( ( source.flags_ & FIELD_TEXT_EXT ) != 0 )
+				{
+					memcpy( &arena_[entry.value_], &view->text_[source.value_], FIELD_TEXT_SLOT );
+				}
+				FieldIndex::GetText( entry, &arena_[entry.value_] );
+			}
+		}
+		// жϣֻv2Я'\0'ֵĸʽv2v2
+		has_binary_ = false;
+		if ( view->version_ == SerializeV2 )
+		{
+			for ( unsigned i = 0; i < entries_.size() && !has_binary_; i++ )
+			{
+				const FieldEntry& entry = entries_[i];
+				has_binary_ = ( entry.type_ == FIELD_STRING && memchr( &arena_[entry.value_], '\0', entry.value_len_ ) != NULL );
+			}
+		}
+		// ߵָ㷨ͬͼѾʱֱ
+		if ( view->has_fingerprint_ )
+		{
+			fingerprint_ = view->fingerprint_;
+			return;
+		}
+		for ( unsigned i = 0; i < entries_.size(); i++ )
+		{
+			fingerprint_ += HashEntry( entries_[i] );
+		}
+	}
+
+	int NodeValue::NodeValueImpl::GetSerializedSize( int version ) const
+	{
+		if ( version == 0 )
+		{
+			version = has_binary_ ? SerializeV2 : default_version_;
+		}
+		unsigned size = 0;
+		if ( version == SerializeV2 )
+		{
+			bool is_typed = FieldIndex::GetNumberCount( entries_ ) > 0;
+			size = V2_HEADER_LEN + FieldIndex::GetVarintSize( entries_.size() );
+			for ( unsigned i = 0; i < entries_.size(); i++ )
+			{
+				const FieldEntry& entry = entries_[i];
+				size += FieldIndex::GetVarintSize( entry.key_len_ ) + entry.key_len_ + 1;
+				if ( is_typed )
+				{
+					size += 1;
+				}
+				if ( entry.type_ == FIELD_INT64 )
+				{
+					unsigned long long zigzag = ( (unsigned long long)entry.number_.int_ << 1 ) ^ (unsigned long long)( entry.number_.int_ >> 63 );
+					size += FieldIndex::GetVarintSize( zigzag );
+				}
+				else if ( entry.type_ == FIELD_DOUBLE )
+				{
+					size += 8;
+				}
+				else
+				{
+					size += FieldIndex::GetVarintSize( entry.value_len_ ) + entry.value_len_ + 1;
+				}
+			}
+			return size;
+		}
+		for ( unsigned i = 0; i < entries_.size(); i++ )
+		{
+			size += entries_[i].key_len_ + entries_[i].value_len_ + 2;
+		}
+		return size;
+	}
+
+	bool NodeValue::NodeValueImpl::Serialize( char* buff, int& len, int version ) const
+	{
+		if ( version == 0 )
+		{
+			// жʱֻʹv2
+			version = has_binary_ ? SerializeV2 : default_version_;
+		}
+		if ( version == SerializeV2 )
+		{
+			return EncodeV2( buff, len );
+		}
+		if ( has_binary_ )
+		{
+			for ( unsigned i = 0; i < entries_.size(); i++ )
+			{
+				const FieldEntry& entry = entries_[i];
+				if ( entry.type_ == FIELD_STRING && memchr( &arena_[entry.value_], '\0', entry.value_len_ ) != NULL )
+				{
+					return false;
+				}
+			}
+		}
+		return EncodeV1( buff, len );
+	}
+
+	bool NodeValue::NodeValueImpl::EncodeV1( char* buff, int& len ) const
+	{
+		if ( len < 0 )
+		{
+			return false;
+		}
+		unsigned buffer_len = 0;
+		for ( unsigned i = 0; i < entries_.size(); i++ )
+		{
+			const FieldEntry& entry = entries_[i];
+			unsigned str_len = entry.key_len_ + 1;
+			if ( buffer_len + str_len > (unsigned)len )
+			{
+				return false;
+			}
+			memcpy( buff + buffer_len, GetKeyString( entry ), str_len );
+			buffer_len += str_len;
+
+			// v1ֵֶıʽ
+			const char* text = GetText( entry );
+			str_len = entry.value_len_ + 1;
+			if ( buffer_len + str_len > (unsigned)len )
+			{
+				return false;
+			}
+			memcpy( buff + buffer_len, text, str_len );
+			buffer_len += str_len;
+		}
+		len = buffer_len;
+		return true;
+	}
+
+	bool NodeValue::NodeValueImpl::EncodeV2( char* buff, int& len ) const
+	{
+		if ( len < V2_HEADER_LEN )
+		{
+			return false;
+		}
+		bool is_typed = FieldIndex::GetNumberCount( entries_ ) > 0;
+		buff[0] = '\0';
+		buff[1] = 'Z';
+		buff[2] = 'V';
+		buff[3] = SerializeV2;
+		buff[4] = V2_FLAG_COUNT | ( is_typed ? V2_FLAG_TYPED : 0 );
+		unsigned buffer_len = V2_HEADER_LEN;
+		if ( buffer_len + FieldIndex::GetVarintSize( entries_.size() ) > (unsigned)len )
+		{
+			return false;
+		}
+		buffer_len += FieldIndex::WriteVarint( buff + buffer_len, entries_.size() );
+
+		for ( unsigned i = 0; i < entries_.size(); i++ )
+		{
+			const FieldEntry& entry = entries_[i];
+			// 󳤶Ԥvarint͡8ֵֽ
+			unsigned str_len = FieldIndex::GetVarintSize( entry.key_len_ ) + entry.key_len_ + 1 + 1;
+			if ( buffer_len + str_len > (unsigned)len )
+			{
+				return false;
+			}
+			buffer_len += FieldIndex::WriteVarint( buff + buffer_len, entry.key_len_ );
+			memcpy( buff + buffer_len, GetKeyString( entry ), entry.key_len_ + 1 );
+			buffer_len += entry.key_len_ + 1;
+			if ( is_typed )
+			{
+				buff[buffer_len++] = (char)entry.type_;
+			}
+
+			if ( entry.type_ == FIELD_INT64 )
+			{
+				unsigned long long zigzag = ( (unsigned long long)entry.number_.int_ << 1 ) ^ (unsigned long long)( entry.number_.int_ >> 63 );
+				if ( buffer_len + FieldIndex::GetVarintSize( zigzag ) > (unsigned)len )
+				{
+					return false;
+				}
+				buffer_len += FieldIndex::WriteVarint( buff + buffer_len, zigzag );
+			}
+			else if ( entry.type_ == FIELD_DOUBLE )
+			{
+				if ( buffer_len + 8 > (unsigned)len )
+				{
+					return false;
+				}
+				unsigned long long bits = 0;
+				memcpy( &bits, &entry.number_.double_, sizeof(bits) );
+				for ( int j = 0; j < 8; j++ )
+				{
+					buff[buffer_len++] = (char)( bits >> ( j * 8 ) );
+				}
+			}
+			else
+			{
+				str_len = FieldIndex::GetVarintSize( entry.value_len_ ) + entry.value_len_ + 1;
+				if ( buffer_len + str_len > (unsigned)len )
+				{
+					return false;
+				}
+				buffer_len += FieldIndex::WriteVarint( buff + buffer_len, entry.value_len_ );
+				memcpy( buff + buffer_len, &arena_[entry.value_], entry.value_len_ + 1 );
+				buffer_len += entry.value_len_ + 1;
+			}
+		}
+		len = buffer_len;
+		return true;
+	}
+
+	NodeValue* NodeValue::NodeValueImpl::Clone() const
+	{
+		NodeValue* value = NodeValue::Create();
+		value->impl_->entries_ = entries_;
+		value->impl_->arena_ = arena_;
+		value->impl_->garbage_ = garbage_;
+		value->impl_->has_binary_ = has_binary_;
+		value->impl_->fingerprint_ = fingerprint_;
+		value->impl_->Compact();
+		return value;
+	}
+
+	void NodeValue::NodeValueImpl::Release( NodeValueImpl* impl )
+	{
+		if ( impl != NULL && ZK_ATOMIC_DEC( &impl->refs_ ) == 0 )
+		{
+			delete impl;
+		}
+	}
+
+	NodeValue::NodeValueImpl* NodeValue::NodeValueImpl::Unshare( NodeValueImpl* impl, bool is_keep )
+	{
+		if ( !impl->IsShared() )
+		{
+			return impl;
+		}
+		NodeValueImpl* copy = new NodeValueImpl();
+		if ( is_keep )
+		{
+			copy->entries_ = impl->entries_;
+			copy->arena_ = impl->arena_;
+			copy->garbage_ = impl->garbage_;
+			copy->has_binary_ = impl->has_binary_;
+			copy->fingerprint_ = impl->fingerprint_;
+		}
+		Release( impl );
+		return copy;
+	}
+
+	void NodeValue::NodeValueImpl::Recycle()
+	{
+		DeleteAll();
+		if ( arena_.capacity() > NODE_POOL_MAX_BYTES )
+		{
+			std::vector<char>().swap( arena_ );
+		}
+		if ( entries_.capacity() * sizeof(FieldEntry) > NODE_POOL_MAX_BYTES )
+		{
+			FieldEntries().swap( entries_ );
+		}
+	}
+
+	unsigned long long NodeValue::NodeValueImpl::GetMemorySize() const
+	{
+		return sizeof(NodeValue) + sizeof(NodeValueImpl) + arena_.capacity() + entries_.capacity() * sizeof(FieldEntry);
+	}
+
+	unsigned NodeValue::NodeValueImpl::Append( const char* str, unsigned len )
+	{
+		unsigned offset = arena_.size();
+		arena_.resize( offset + len + 1 );
+		memcpy( &arena_[offset], str, len );
+		arena_[offset + len] = '\0';
+		return offset;
+	}
+
+	unsigned NodeValue::NodeValueImpl::AppendSlot()
+	{
+		unsigned offset = arena_.size();
+		arena_.resize( offset + FIELD_TEXT_SLOT, '\0' );
+		return offset;
+	}
+
+	bool NodeValue::NodeValueImpl::IsInArena( const char* str ) const
+	{
+		if ( arena_.empty() )
+		{
+			return false;
+		}
+		const char* begin = &arena_[0];
+		return ( str >= begin && str < begin + arena_.size() );
+	}
+
+	void NodeValue::NodeValueImpl::Compact()
+	{
+		// ռСʱƵ
+		if ( garbage_ < 256 || garbage_ * 2 < arena_.size() )
+		{
+			return;
+		}
+		std::vector<char> arena;
+		arena.reserve( arena_.size() - garbage_ );
+		for ( unsigned i = 0; i < entries_.size(); i++ )
+		{
+			FieldEntry& entry = entries_[i];
+			unsigned offset = 0;
+			if ( ( entry.flags_ & FIELD_KEY_LOCAL ) != 0 )
+			{
+				offset = arena.size();
+				arena.insert( arena.end(), arena_.begin() + entry.key_, arena_.begin() + entry.key_ + entry.key_len_ + 1 );
+				entry.key_ = offset;
+			}
+
+			offset = arena.size();
+			arena.insert( arena.end(), arena_.begin() + entry.value_, arena_.begin() + entry.value_ + GetValueSpace( entry ) );
+			entry.value_ = offset;
+		}
+		arena_.swap( arena );
+		garbage_ = 0;
+	}
+
+	NodeValueView* NodeValueView::Create()
+	{
+		return new NodeValueView();
+	}
+	void NodeValueView::Destory( NodeValueView* view )
+	{
+		DEL_PTR(view);
+	}
+	NodeValueView::NodeValueView()
+	{
+		impl_ = new NodeValueViewImpl();
+	}
+	NodeValueView::~NodeValueView()
+	{
+		DEL_PTR(impl_)
+	}
+	bool NodeValueView::Attach( const char* buff, int len )
+	{
+		return impl_->Attach( buff, len );
+	}
+	void NodeValueView::Keep()
+	{
+		impl_->Keep();
+	}
+	unsigned NodeValueView::GetCount() const
+	{
+		return impl_->GetCount();
+	}
+	const char* NodeValueView::GetKey( unsigned index ) const
+	{
+		return impl_->GetKey( index );
+	}
+	const char* NodeValueView::GetValue( unsigned index ) const
+	{
+		return impl_->GetValue( index );
+	}
+	const char* NodeValueView::GetValue( const char* key ) const
+	{
+		return impl_->GetValue( key );
+	}
+	const char* NodeValueView::GetValue( const char* key, unsigned& value_len ) const
+	{
+		return impl_->GetValue( key, value_len );
+	}
+	unsigned NodeValueView::GetValueLength( unsigned index ) const
+	{
+		return impl_->GetValueLength( index );
+	}
+	bool NodeValueView::GetInt64( const char* key, long long& value ) const
+	{
+		return impl_->GetInt64( key, value );
+	}
+	bool NodeValueView::GetDouble( const char* key, double& value ) const
+	{
+		return impl_->GetDouble( key, value );
+	}
+	unsigned long long NodeValueView::GetFingerprint() const
+	{
+		return impl_->GetFingerprint();
+	}
+
+	bool NodeValueView::NodeValueViewImpl::Attach( const char* buff, int len )
+	{
+		Reset();
+		if ( buff == NULL || len <= 0 )
+		{
+			return true;
+		}
+		version_ = FieldIndex::GetVersion( buff, len );
+		if ( version_ == SerializeV2 )
+		{
+			// v2ַ󶼴'\0'ǿԭ
+			if ( !FieldIndex::BuildV2( buff, len, entries_, garbage_ ) )
+			{
+				Reset();
+				return false;
+			}
+			buff_ = buff;
+			len_ = len;
+			// ֵֶֻҪıռ
+			unsigned number_count = FieldIndex::GetNumberCount( entries_ );
+			if ( number_count > 0 )
+			{
+				text_.assign( number_count * FIELD_TEXT_SLOT, '\0' );
+				unsigned slot = 0;
+				for ( unsigned i = 0; i < entries_.size(); i++ )
+				{
+					if ( entries_[i].type_ != FIELD_STRING )
+					{
+						entries_[i].value_ = slot;
+						entries_[i].flags_ |= FIELD_TEXT_EXT;
+						slot += FIELD_TEXT_SLOT;
+					}
+				}
+			}
+			return true;
+		}
+		if ( FieldIndex::Build( buff, len, len, entries_, garbage_ ) )
+		{
+			buff_ = buff;
+			len_ = len;
+			return true;
+		}
+		// һֶû'\0'β޷ԭãֻܿ
+		owned_.reserve( len + 2 );
+		owned_.assign( buff, buff + len );
+		owned_.push_back( '\0' );
+		owned_.push_back( '\0' );
+		if ( !FieldIndex::Build( &owned_[0], len, owned_.size(), entries_, garbage_ ) )
+		{
+			Reset();
+			return false;
+		}
+		buff_ = &owned_[0];
+		len_ = owned_.size();
+		return true;
+	}
+
+	void NodeValueView::NodeValueViewImpl::Keep()
+	{
+		if ( buff_ == NULL || ( !owned_.empty() && buff_ == &owned_[0] ) )
+		{
+			return;
+		}
+		owned_.assign( buff_, buff_ + len_ );
+		buff_ = &owned_[0];
+	}
+
+	void NodeValueView::NodeValueViewImpl::Reset()
+	{
+		buff_ = NULL;
+		len_ = 0;
+		garbage_ = 0;
+		version_ = SerializeV1;
+		has_fingerprint_ = false;
+		entries_.clear();
+		owned_.clear();
+		text_.clear();
+	}
+
+	unsigned long long NodeValueView::NodeValueViewImpl::GetFingerprint() const
+	{
+		if ( !has_fingerprint_ )
+		{
+			fingerprint_ = 0;
+			for ( unsigned i = 0; i < entries_.size(); i++ )
+			{
+				const FieldEntry& entry = entries_[i];
+				fingerprint_ += FieldIndex::HashField( buff_ + entry.key_, entry, buff_ + entry.value_ );
+			}
+			has_fingerprint_ = true;
+		}
+		return fingerprint_;
+	}
+
+	const char* NodeValueView::NodeValueViewImpl::GetText( FieldEntry& entry ) const
+	{
+		if ( ( entry.flags_ & FIELD_TEXT_EXT ) != 0 )
+		{
+			return FieldIndex::GetText( entry, &text_[entry.value_] );
+		}
+		return buff_ + entry.value_;
+	}
+
+	FieldEntry* NodeValueView::NodeValueViewImpl::Find( const char* key ) const
+	{
+		if ( key == NULL || entries_.empty() )
+		{
+			return NULL;
+		}
+		bool is_find = false;
+		unsigned pos = FieldIndex::LowerBound( buff_, entries_, key, strlen( key ), is_find );
+		if ( is_find )
+		{
+			return &entries_[pos];
+		}
+		return NULL;
+	}
+
+	const char* NodeValueView::NodeValueViewImpl::GetKey( unsigned index ) const
+	{
+		if ( index >= entries_.size() )
+		{
+			return NULL;
+		}
+		return buff_ + entries_[index].key_;
+	}
+
+	const char* NodeValueView::NodeValueViewImpl::GetValue( unsigned index ) const
+	{
+		if ( index >= entries_.size() )
+		{
+			return NULL;
+		}
+		return GetText( entries_[index] );
+	}
+
+	const char* NodeValueView::NodeValueViewImpl::GetValue( const char* key ) const
+	{
+		FieldEntry* entry = Find( key );
+		if ( entry != NULL )
+		{
+			return GetText( *entry );
+		}
+		return NULL;
+	}
+
+	const char* NodeValueView::NodeValueViewImpl::GetValue( const char* key, unsigned& value_len ) const
+	{
+		value_len = 0;
+		FieldEntry* entry = Find( key );
+		if ( entry != NULL )
+		{
+			const char* text = GetText( *entry );
+			value_len = entry->value_len_;
+			return text;
+		}
+		return NULL;
+	}
+
+	unsigned NodeValueView::NodeValueViewImpl::GetValueLength( unsigned index ) const
+	{
+		if ( index >= entries_.size() )
+		{
+			return 0;
+		}
+		GetText( entries_[index] );
+		return entries_[index].value_len_;
+	}
+
+	bool NodeValueView::NodeValueViewImpl::GetInt64( const char* key, long long& value ) const
+	{
+		FieldEntry* entry = Find( key );
+		if ( entry != NULL )
+		{
+			return FieldIndex::GetInt64( *entry, buff_, value, true );
+		}
+		return false;
+	}
+
+	bool NodeValueView::NodeValueViewImpl::GetDouble( const char* key, double& value ) const
+	{
+		FieldEntry* entry = Find( key );
+		if ( entry != NULL )
+		{
+			return FieldIndex::GetDouble( *entry, buff_, value, true );
+		}
+		return false;
+	}
+
+	// лû
+	// СֱʹջϿռ䣬STACK_BUFFʱGetSerializedSizeڶϷ
+	class SerializeBuffer
+	{
+	public:
+		SerializeBuffer():data_(stack_),len_(0){}
+		~SerializeBuffer()
+		{
+			if ( data_ != stack_ )
+			{
+				DEL_PTR_ARRAY( data_ );
+			}
+		}
+		// MAX_NODE_BUFFҲܾлʧʱfalse
+		bool Serialize( NodeValue* value )
+		{
+			if ( value == NULL )
+			{
+				return false;
+			}
+			int size = value->GetSerializedSize();
+			if ( size > MAX_NODE_BUFF )
+			{
+				return false;
+			}
+			if ( size > STACK_BUFF )
+			{
+				data_ = new char[size];
+			}
+			len_ = size;
+			return value->Serialize( data_, len_ );
+		}
+		const char* GetData() const { return data_; }
+		int GetLength() const { return len_; }
+	private:
+		char stack_[STACK_BUFF];
+		char* data_;
+		int len_;
+	};
+
+	/*
+		NodeValueճأÿclientһĬϹرգ
+		еNodeValueͷʱŻسУٴμʱֱӸã
+		Ϊÿڵظͷڴ棻رջclientʱһͷ
+		ûDetachNodeValue
+	*/
+	class NodeValuePool
+	{
+	public:
+		NodeValuePool():is_enable_(false){}
+		~NodeValuePool(){ Clear(); }
+		void SetEnable( bool is_enable )
+		{
+			is_enable_ = is_enable;
+			if ( !is_enable_ )
+			{
+				Clear();
+			}
+		}
+		NodeValue* Create()
+		{
+			if ( free_.empty() )
+			{
+				return NodeValue::Create();
+			}
+			NodeValue* value = free_.back();
+			free_.pop_back();
+			return value;
+		}
+		void Destory( NodeValue* value )
+		{
+			if ( value == NULL )
+			{
+				return;
+			}
+			if ( !is_enable_ || value->impl_->IsShared() )
+			{
+				NodeValue::Destory( value );
+				return;
+			}
+			value->impl_->Recycle();
+			free_.push_back( value );
+		}
+		void Clear()
+		{
+			for ( unsigned i = 0; i < free_.size(); i++ )
+			{
+				NodeValue::Destory( free_[i] );
+			}
+			std::vector<NodeValue*>().swap( free_ );
+		}
+		unsigned GetCount() const{ return free_.size(); }
+		// ݵĸڿգӰ컺NodeValueĻպԭ޸
+		static NodeValue* CreateCopy( const NodeValue* value )
+		{
+			return value->Clone();
+		}
+		static unsigned long long GetMemorySize( const NodeValue* value )
+		{
+			return value == NULL ? 0 : value->impl_->GetMemorySize();
+		}
+		unsigned long long GetMemorySize() const
+		{
+			unsigned long long size = 0;
+			for ( unsigned i = 0; i < free_.size(); i++ )
+			{
+				size += GetMemorySize( free_[i] );
+			}
+			return size;
+		}
+	private:
+		bool is_enable_;
+		std::vector<NodeValue*> free_;
+	};
+
+	/*
+		صɷ
+		ÿclientһɷУлصʱҵɷľб߳ÿȡһִһص
+		ִлصһؾбĩβͬһͬʱֻһִ߳У֤˳
+		же״̬ɷ
+	*/
+#define DISPATCH_MAX_THREADS	64
+
+	struct DispatchTask
+	{
+		DispatchTask():callback_(NULL),choice_client_(NULL),post_time_(0),next_(NULL){}
+		~DispatchTask();
+		ZkCallback callback_;
+		CallbackParam param_;
+		// صָָݣɷʱ
+		string path_;
+		vector<NodeValue*> values_;
+		vector<NodeValue*> reserves_;
+		// ApplySuccessCbص֮ͻ˴ѡ
+		IZkApplyClient::ZkApplyClientImpl* choice_client_;
+		unsigned long long post_time_;
+		DispatchTask* next_;
+	};
+
+	class ZkDispatchQueue
+	{
+	public:
+		ZkDispatchQueue():is_enable_(false),head_(NULL),tail_(NULL),is_scheduled_(false),is_running_(false){}
+		~ZkDispatchQueue(){ Close(); }
+		// رʱȴеĻصִ
+		void SetEnable( bool is_enable );
+		// Уδɷδʱfalseɵֱִлص
+		bool Post( ZkCallback callback, const CallbackParam& param, IZkApplyClient::ZkApplyClientImpl* choice_client = NULL );
+		// δִеĻصȴִеĻصڱеĻصе
+		void Close();
+	private:
+		friend class ZkDispatcher;
+		bool is_enable_;
+		DispatchTask* head_;
+		DispatchTask* tail_;
+		// ھблִ
+		bool is_scheduled_;
+		bool is_running_;
+	};
+
+	class ZkDispatcher
+	{
+	public:
+		static bool Start( unsigned thread_count );
+		static void Stop();
+		static void GetStats( DispatchStats& stats );
+		static void Run();
+	private:
+		friend class ZkDispatchQueue;
+		static bool is_running_;
+		static bool is_stopping_;
+		static vector<pthread_t> threads_;
+		static list<ZkDispatchQueue*> ready_;
+		// лصִ/лصִ
+		static pthread_cond_t work_cond_;
+		static pthread_cond_t idle_cond_;
+		static DispatchStats stats_;
+	public:
+		static pthread_mutex_t mutex_;
+	};
+
+	/*
+		¼ѭʽӵ̵߳zookeeper_stʱTHREADED
+		zkIOͻص̣߳ɵͨPoll/ProcesszkĻصProcessִ
+		clientmutex_û߳еzkProcess⣨̵߳zk̰߳ȫģ
+		صйرվỰڶʱƳٵzookeeper_process֮
+	*/
+	class ZkEventLoop
+	{
+	public:
+		ZkEventLoop():closing_handle_(NULL),is_processing_(false){}
+		// ȡҪfd¼ZkPollEventͳʱ룩̰߳汾ZAPIERROR
+		int Poll( zhandle_t* zh, int& fd, int& events, int& timeout );
+		int Process( zhandle_t* zh, int events );
+		// zookeeper_close
+		int Close( zhandle_t* zh );
+	private:
+		zhandle_t* closing_handle_;
+		bool is_processing_;
+	};
+
+	/*
+		ỰأclientSetSharedSessionʹã
+		ͬhostclientһzkỰüرգỰ¼תʹøûỰclient
+		ỰںӳƳ֮ConnectὨµĻỰ
+		zkĻصclientִУclientϿҪԼɾʱڵwatch
+	*/
+	struct ZkSession
+	{
+		struct Watcher
+		{
+			watcher_fn fn_;
+			void* context_;
+		};
+		string host_;
+		zhandle_t* handle_;
+		uintptr_t id_;
+		// Ựclienttime_out֮Attachclientͬʱֻӡ
+		int time_out_;
+		// һλỰ¼״̬
+		int state_;
+		vector<Watcher> watchers_;
+	};
+
+	class ZkSessionPool
+	{
+	public:
+		// ȡhostĻỰûʱfncontextջỰ¼is_connectedػỰǷѾӣյ¼
+		static zhandle_t* Attach( const char* host, int time_out, watcher_fn fn, void* context, bool& is_connected );
+		// һclientϿʱرջỰzookeeper_closeĽ
+		static int Detach( zhandle_t* zh, void* context );
+		static unsigned GetSessionCount();
+	private:
+		static void Watch( zhandle_t* zh, int type, int state, const char* path, void* watcherCtx );
+		// id->ỰصʹidỰɾ󲻻ȡ
+		typedef map<uintptr_t,ZkSession*> Sessions;
+		static Sessions sessions_;
+		// host->ỰڵĻỰУ
+		typedef map<string,ZkSession*> Hosts;
+		static Hosts hosts_;
+		static uintptr_t session_index_;
+	public:
+		static pthread_mutex_t mutex_;
+	};
+
+	/*
+		ʱһֲ̣߳ʱ֣
+		0256ۣÿһ̶ȣ364ۣһ۵һתһȦ
+		0תһȦʱһһƣcascadeӺȡO(1)ÿ̶ֻһ
+		ûжʱʱ̵߳ȴתصڶʱִ߳У
+	*/
+#define TIMER_TICK_MS		100
+#define TIMER_ROOT_BITS		8
+#define TIMER_LEVEL_BITS	6
+#define TIMER_LEVELS		3
+#define TIMER_ROOT_SIZE		( 1 << TIMER_ROOT_BITS )
+#define TIMER_LEVEL_SIZE	( 1 << TIMER_LEVEL_BITS )
+// ʱ̶ʱԼ77죩
+#define TIMER_MAX_TICKS		( ( 1ULL << ( TIMER_ROOT_BITS + TIMER_LEVEL_BITS * TIMER_LEVELS ) ) - 1 )
+
+	typedef void (*TimerFunc)( uintptr_t arg );
+
+	struct ZkTimer
+	{
+		ZkTimer():id_(0),expires_(0),func_(NULL),arg_(0),prev_(this),next_(this){}
+		uintptr_t id_;
+		// ڵĿ̶
+		unsigned long long expires_;
+		TimerFunc func_;
+		uintptr_t arg_;
+		// ڵ˫ѭͷǲʹõZkTimer
+		ZkTimer* prev_;
+		ZkTimer* next_;
+	};
+
+	class ZkTimerWheel
+	{
+	public:
+		// delay_msڶʱ߳еfunc(arg)ضʱidΪ0
+		static uintptr_t Add( unsigned delay_ms, TimerFunc func, uintptr_t arg );
+		// ѾڣصڻѾִУʱfalse
+		static bool Cancel( uintptr_t timer_id );
+		static unsigned GetCount();
+		static void Run();
+	private:
+		static unsigned long long GetTick();
+		// ڿ̶ȷӦĲ
+		static void Insert( ZkTimer* timer );
+		static void Link( ZkTimer* head, ZkTimer* timer );
+		static void Unlink( ZkTimer* timer );
+		// ·ϲһеĶʱز±꣨Ϊ0ʱƸһ㣩
+		static unsigned Cascade( unsigned level );
+		static ZkTimer root_[TIMER_ROOT_SIZE];
+		static ZkTimer levels_[TIMER_LEVELS][TIMER_LEVEL_SIZE];
+		// id->ʱȡʱ
+		typedef map<uintptr_t,ZkTimer*> Timers;
+		static Timers timers_;
+		static uintptr_t timer_index_;
+		// һҪĿ̶
+		static unsigned long long current_tick_;
+		static bool is_running_;
+		static pthread_cond_t work_cond_;
+	public:
+		static pthread_mutex_t mutex_;
+	};
+
+	typedef enum EmNodeState
+	{
+		emNormal = 0,
+		emNodeCreating,		
+	}NodeState;
+
+	class NodeInfo 
+	{
+	public:
+		NodeInfo():path_(""),node_state_(emNodeCreating),type_(""), node_need_update_(false){
+			value_ = NodeValue::Create();
+		}
+		~NodeInfo(){
+			NodeValue::Destory( value_ );
+		}
+		bool IsCreated(){ return (path_ != "");}
+		const char* GetType(){ return type_.c_str(); }
+		void SetType( const char* type ){ type_ = type; }
+		const char* GetPath(){ return path_.c_str(); }
+		void SetPath( const char* path ){ path_ = path; }
+		NodeValue* GetValue(){ return value_; }
+		void SetValue( NodeValue* value )
+		{
+			if ( value == value_ )
+			{
+				return;
+			}
+			// ߹ݣ֮޸valueʱŻḴ
+			NodeValue::Destory( value_ );
+			value_ = value->Detach();
+		}
+		void SetNodeState( NodeState state  ){ node_state_ = state; }
+		NodeState GetNodeState(){ return node_state_; }
+		void NodeNeedUpdate( bool update ){ node_need_update_ = update; }
+		bool IsNodeNeedUpdate(){ return node_need_update_; }
+	protected:
+		std::string path_;
+		std::string type_;
+		NodeValue* value_;
+		NodeState node_state_;
+		bool node_need_update_;
+	};
+
+	typedef enum emNodeType{
+		ApplyNode,
+		ReserveNode,
+		SourceNode
+	}NodeType;
+
+	class Context;
+	// ͻ˳еʽָContextУֻڳcontext_mutex_ʱ
+	struct ContextList
+	{
+		ContextList():head_(NULL),count_(0),orphan_count_(0),is_closing_(false){}
+		// ͻʱɾʣ
+		~ContextList();
+		Context* head_;
+		unsigned count_;
+		// ʼɾ󴴽ûcookieصȡֻϣʱͷ
+		unsigned orphan_count_;
+		// ClearʼΪÿͻ˵ķcookie
+		bool is_closing_;
+	};
+
+	class IZkRegisterClient::ZkRegisterClientImpl
+	{
+	public:
+		ZkRegisterClientImpl( ZkCallback callback, void* context = NULL,
+			char* root_path = "/Resource", char* source_path = "/Source", IZkRegisterClient* parent =NULL)
+			: zkhandle_(NULL), root_path_(root_path), source_path_(source_path), 
+			system_state_(zkDisconnect), 
+			callback_( callback ),
+			callback_context_(context),index_(0),
+			parent_(parent),connect_context_(0),
+			is_shared_session_(false),session_context_(0)
+			{
+				Init( true );
+		}
+		virtual ~ZkRegisterClientImpl(void){
+			dispatch_queue_.Close();
+			DisConnect();
+			Init( false );
+		}
+	public:
+		bool Connect( const char* host, int time_out = 10000 );
+		bool ReConnect( const char* host, int time_out = 10000 );
+		bool RestoreRegisteredNode();
+		int DisConnect();
+		// رջ黹Ựzk
+		int CloseHandle( zhandle_t* zkhandle, bool is_shared_session );
+
+		int Register( const char* res, NodeValue* value, NodeID& id );
+		int Change( NodeID& id, NodeValue* value );
+		int Delete( NodeID& id );
+		ZkSystemState GetSystemState(){ return system_state_; }
+	protected:
+		NodeInfo* GetResInfo( NodeID id );	
+		// ϵͳWatch
+		static void Watch(zhandle_t *zh, int type, int state, const char *path,void *watcherCtx);
+		// Registerص
+		static void StringCB(int rc, const char *value, const void *data);
+		// Deleteص
+		static void DeleteCB(int rc, const void *data);
+		// Chanageص
+		static void StatCB(int rc, const struct Stat *stat, const void *data);
+		static void VoidCB(int rc, const void *data){}
+	
+
+		void OnRegisterRsp( int rc, const char* value, NodeID id );
+		void OnChangeRsp( int rc, const char* value, NodeID id );
+		void OnDeleteRsp( int rc, const char* value, NodeID id );
+
+		void UpdateNodeInfo( NodeID id, const char* path );
+		void RemoveNodeInfo( NodeID id );
+		void RemoveAllNodeInfo();
+		
+		void OnConnected();
+		void OnConnecting();
+		void OnDisconnected();
+		void RemoveAllNode();
+		// ִûصɷʱɷУ
+		void Notify( CallbackParam& param );
+	public:
+		IZkRegisterClient* GetParent(){ return parent_; }
+		void SetDispatch( bool is_enable ){ dispatch_queue_.SetEnable( is_enable ); }
+		// δִеĻصȴִеĻص֮ɷɾclientʱʹã
+		void CloseDispatch(){ dispatch_queue_.Close(); }
+		void SetSharedSession( bool is_enable );
+		int Poll( int& fd, int& events, int& timeout );
+		int Process( int events );
+		bool Init( bool bInit = true );
+		void Print();
+	private:
+		pthread_mutex_t mutex_;
+	private:
+		// zkͻ˾
+		zhandle_t* zkhandle_;
+		// Դ·
+		string source_path_;
+		// ڵ·
+		string root_path_;
+
+		ZkCallback callback_;
+		void* callback_context_;
+		ZkDispatchQueue dispatch_queue_;
+		ZkEventLoop event_loop_;
+		ZkAtomicValue<ZkSystemState> system_state_;
+
+		// Դ
+		typedef map<NodeID,NodeInfo*> Nodes;
+		Nodes nodes_;
+
+		NodeID index_;
+		IZkRegisterClient* parent_;
+
+		// contextcookie
+		uintptr_t connect_context_;
+		// ʹûỰеĹỰZkSessionPoolsession_context_ΪAttachʱ
+		bool is_shared_session_;
+		uintptr_t session_context_;
+	public:
+		// ͻδɾģɾͻʱֻЩ
+		ContextList contexts_;
+	};
+
+	/*
+		Դؿգ޸
+		NodeValueǻĸ뻺湲ݣֻͨconstӿڶȡ߳̿ͬʱȡ
+		ڵ㣨Itemüûб仯Ľڵǰ֮乲ʱֻƱ仯Ľڵ
+	*/
+	class SourceSnapshot::SourceSnapshotImpl
+	{
+	public:
+		SourceSnapshotImpl():refs_(1),version_(0){}
+		~SourceSnapshotImpl()
+		{
+			for ( unsigned i = 0; i < sources_.size(); i++ )
+			{
+				sources_[i]->Release();
+			}
+			for ( unsigned i = 0; i < reserves_.size(); i++ )
+			{
+				reserves_[i]->Release();
+			}
+		}
+		struct Item
+		{
+			Item( const string& path, NodeValue* value ):path_(path),value_(value),refs_(1){}
+			~Item(){ NodeValue::Destory( value_ ); }
+			void AddRef(){ ZK_ATOMIC_INC( &refs_ ); }
+			void Release()
+			{
+				if ( ZK_ATOMIC_DEC( &refs_ ) == 0 )
+				{
+					delete this;
+				}
+			}
+			string path_;
+			NodeValue* value_;
+			volatile long refs_;
+		};
+		typedef vector<Item*> Items;
+		// Դڵ㣨ֻѼصģԤռڵ㣬·
+		Items sources_;
+		Items reserves_;
+		volatile long refs_;
+		unsigned long long version_;
+	};
+
+	SourceSnapshot::SourceSnapshot():impl_( new SourceSnapshotImpl() )
+	{
+	}
+
+	SourceSnapshot::~SourceSnapshot()
+	{
+		DEL_PTR( impl_ );
+	}
+
+	void SourceSnapshot::AddRef()
+	{
+		ZK_ATOMIC_INC( &impl_->refs_ );
+	}
+
+	void SourceSnapshot::Release()
+	{
+		if ( ZK_ATOMIC_DEC( &impl_->refs_ ) == 0 )
+		{
+			delete this;
+		}
+	}
+
+	unsigned long long SourceSnapshot::GetVersion() const
+	{
+		return impl_->version_;
+	}
+
+	unsigned SourceSnapshot::GetSourceCount() const
+	{
+		return impl_->sources_.size();
+	}
+
+	const char* SourceSnapshot::GetSourcePath( unsigned index ) const
+	{
+		return index < impl_->sources_.size() ? impl_->sources_[index]->path_.c_str() : NULL;
+	}
+
+	const NodeValue* SourceSnapshot::GetSource( unsigned index ) const
+	{
+		return index < impl_->sources_.size() ? impl_->sources_[index]->value_ : NULL;
+	}
+
+	unsigned SourceSnapshot::GetReserveCount() const
+	{
+		return impl_->reserves_.size();
+	}
+
+	const char* SourceSnapshot::GetReservePath( unsigned index ) const
+	{
+		return index < impl_->reserves_.size() ? impl_->reserves_[index]->path_.c_str() : NULL;
+	}
+
+	const NodeValue* SourceSnapshot::GetReserve( unsigned index ) const
+	{
+		return index < impl_->reserves_.size() ? impl_->reserves_[index]->value_ : NULL;
+	}
+
+	class IZkApplyClient::ZkApplyClientImpl
+	{
+	public:
+		ZkApplyClientImpl(	char* res_type, 
+			ZkCallback callback,
+			void* context = NULL,
+			char* root_name = "/Resource", 
+			char* apply_queue_name = "/ApplyQueue",
+			char* reserve_queue_name = "/ReserveQueue",
+			char* source_name = "/Source",
+			IZkApplyClient* parent = NULL) 
+			: callback_(callback),
+			callback_context_(context),
+			res_type_(res_type),zkhandle_(NULL), 
+			apply_state_(idle), 
+			system_state_(zkDisconnect),
+			is_inited_(false),
+			parent_(parent),
+			connect_context_(0),
+			is_shared_session_(false),
+			session_context_(0),
+			apply_context_(0),
+			apply_seq_(0),
+			apply_pos_(-1),
+			apply_timer_(0),
+			apply_timer_context_(0)
+		{
+			static int client_index = 0;
+			client_id_ = ++client_index;
+			source_path_ = root_name;
+			source_path_ += "/";
+			source_path_ += res_type_;
+
+			reserve_queue_path_ = source_path_;
+			apply_queue_path_ = source_path_;
+			source_path_ += source_name;
+
+			reserve_queue_path_ += reserve_queue_name;
+			apply_queue_path_ += apply_queue_name;	
+
+			reserve_list_watch_context_ = 0;
+			source_list_wath_context_ = 0;
+
+			apply_node_watch_context_ = 0;
+
+			connect_context_ = 0;
+			node_view_ = NodeValueView::Create();
+			snapshot_ = new SourceSnapshot();
+			is_snapshot_dirty_ = false;
+
+			Init();
+		}
+
+		virtual ~ZkApplyClientImpl(void)
+		{
+			dispatch_queue_.Close();
+			Disconnect();	
+			Init( false );
+			NodeValueView::Destory( node_view_ );
+			snapshot_->Release();
+		}
+	public:
+		bool Connect( const char* host, int time_out = 10000 );
+		int Apply( unsigned time_out = 10000 );
+		int CancelApply();
+		int Disconnect();
+		// رջ黹Ựzk
+		int CloseHandle( zhandle_t* zkhandle, bool is_shared_session );
+		ZkSystemState GetSystemState(){return system_state_;}
+		void SetValuePool( bool is_enable );
+		void GetCacheStats( CacheStats& stats );
+		SourceSnapshot* GetSourceSnapshot();
+		void SetDispatch( bool is_enable ){ dispatch_queue_.SetEnable( is_enable ); }
+		// δִеĻصȴִеĻص֮ɷɾclientʱʹã
+		void CloseDispatch(){ dispatch_queue_.Close(); }
+		void SetSharedSession( bool is_enable );
+		int Poll( int& fd, int& events, int& timeout );
+		int Process( int events );
+		// ûApplySuccessCbеѡ񣨴Ԥռڵ㣩
+		void OnChoice( CallbackParam& param );
+	protected:
+		// ִûصɷʱɷУ
+		void Notify( CallbackParam& param );
+		// ȡԤռбԴб
+		bool LoadSource();
+	protected:
+		// ȡбwatch
+		bool GetApplyList();
+		// бͬʱжǷԴȨޣδʱwatchǰһڵ
+		bool UpdateApplyList( int rc, const struct String_vector *strings );
+		// ǷѾеһλãԴȨޣͬʱŶλãʱpre_nodeǰһڵ
+		bool IsFirstPos( const struct String_vector *strings, string& pre_node );
+		// صApplyAckCbڵ㴴»ȡбŶλñ仯ʱ
+		void NotifyApplyAck();
+		// ǰһڵ㣨·exists watchýڵɾʱ»ȡб
+		bool WatchPreNode( const string& pre_path );
+		// ǰһڵexistsصZOKڡZNONODEɾΪӴ
+		void UpdatePreNode( int rc, const char* path );
+		// ǰһڵwatch¼ɾ֮¼watch
+		void UpdatePreNodeEvent( int type, const char* path );
+		// ǰһڵɾʱ»ȡбwatchеȴOnConnected»ȡб
+		void ContinueApply( bool is_pre_deleted );
+		// ûصѡԴ
+		bool DoChoice();
+		// ڵ㣬indexΪʱģѽʱɾٵĽڵ㣩
+		bool UpdateApplyNode( uintptr_t index, int rc, const char* path );
+
+		// ȡԴб
+		int GetSourceList();
+		// ȡԴڵϢ
+		int GetSourceNode( const char* path );
+		// Դб
+		int UpdateSourceList( int rc, const struct String_vector* strings );
+		// Դڵ
+		int UpdateSourceNode( int rc, const char *value, int value_len, const char* path );
+		// Դ»ص
+		void NotifySourceList();
+		// б仯ʱ¿ղ滻ÿصһΣmutex_cache_lock_
+		// ½ڵ㻹ڼʱƳٵ
+		void PublishSnapshot();
+		// ¼֮ı仯pathݱ仯/нڵɾ
+		void MarkSnapshot( const string& path );
+		void MarkSnapshot(){ is_snapshot_dirty_ = true; }
+		// һȡûб仯Ľڵ㣬仯¸posΪ˳ҵλ
+		SourceSnapshot::SourceSnapshotImpl::Item* GetSnapshotItem( const SourceSnapshot::SourceSnapshotImpl::Items& items, 
+			unsigned& pos, const string& path, const NodeValue* value );
+		// ɾеĽڵ¼prefixΪĿ¼/β
+		void RemoveLoading( const string& prefix );
+
+		// ȡԤռб
+		int GetReserveList();
+		// ȡԤռڵ
+		int GetReserveNode( const char* path );
+		// Ԥռб
+		int UpdateReserveList( int rc, const struct String_vector* strings );
+
+		// ȡڵwatchģͬһڵֻһwatchʱ
+		uintptr_t GetNodeWatch( const char* path, NodeType type );
+		// ɾڵwatchģprefixΪĿ¼/βʱɾĿ¼нڵ
+		void RemoveNodeWatch( const char* path );
+		void RemoveNodeWatches( const string& prefix );
+		// Ԥռڵ
+		int UpdateReserveNode( int rc, const char *value, int value_len, const char* path );
+
+		// ڵĻص
+		static void ApplyNodeCB(int rc, const char *value, const void *data);
+		// бص
+		static void ApplyListNotifyCB(int rc,const struct String_vector *strings, const void *data);
+		// ǰһڵexistsص
+		static void PreNodeExistsCB(int rc, const struct Stat *stat, const void *data);
+		// ǰһڵıWatch
+		static void PreNodeChangeWatch(zhandle_t *zh, int type, int state, const char *path,void *watcherCtx);
+
+		// бصڵֵ仯ص
+		static void ListNotifyCB(int rc,const struct String_vector *strings, const void *data);
+		// ڵص
+		static void NodeNotifyCB(int rc, const char *value, int value_len, const struct Stat *stat, const void *data);
+		// бWatch
+		static void ListChangeWatch(zhandle_t *zh, int type, int state, const char *path,void *watcherCtx);
+		// ڵWatch
+		static void NodeChangeWatch(zhandle_t *zh, int type, int state, const char *path,void *watcherCtx);
+
+	private:
+		// watch˵仯ʱ򣬸ǲԶɾ
+		// ԵΪ̶ģڷʹ
+		// ڲ˵ضصԿԼʱ
+		// ɾʱΪ
+		// ֻcookieıClearպ󣬹ڵcookieDestoryֱӺԣͷŵĶ
+		uintptr_t reserve_list_watch_context_;
+		uintptr_t source_list_wath_context_;
+
+		uintptr_t apply_node_watch_context_;
+
+		// contextcookie
+		uintptr_t connect_context_;
+
+	public:
+		// ͻδɾģɾͻʱֻЩ
+		ContextList contexts_;
+		static void ReserveNodeCreateCB(int rc, const char *value, const void *data);
+		// ¼clientԤռڵ㣬ҪԶɾʱӶʱ
+		void OnReserveCreated( const char* path, unsigned auto_delete_time );
+		// Զɾʱڣʱ̣߳indexΪʱ
+		static void AutoDeleteTimer( uintptr_t index );
+		void OnAutoDelete( uintptr_t index, const char* path );
+		// ϿʱȡδڵԶɾỰرպɾ
+		void CancelAutoDeletes();
+		// 볬ʱʱڣʱ̣߳indexΪʱ
+		static void ApplyTimer( uintptr_t index );
+		void OnApplyTimeout( uintptr_t index );
+		// ȡ볬ʱʱ
+		void CancelApplyTimer();
+		static void VoidCB(int rc, const void *data){}
+		static void StatCB(int rc, const struct Stat *stat, const void *data){}
+		static void Watch(zhandle_t *zh, int type, int state, const char *path,void *watcherCtx);
+		IZkApplyClient* GetParent(){ return parent_; }
+	protected:		
+		void OnDisconnected();
+		void OnConnected();
+		void OnConnecting();
+	protected:
+		void EndApply();
+		// 벢صApplyFailCb
+		void FailApply( int rc );
+
+	protected:
+		void RemoveReserveNode( const char* path );
+		void RemoveSourceNode( const char* path );
+
+	public:
+		bool Init( bool bInit = true );
+		void Print();
+	private:
+		ZkCallback callback_;
+		void* callback_context_;
+		ZkDispatchQueue dispatch_queue_;
+		ZkEventLoop event_loop_;
+		zhandle_t* zkhandle_;
+		string apply_queue_path_;
+		string reserve_queue_path_;
+		string source_path_;
+		string res_type_;
+		string apply_path_;
+
+		typedef map<string,NodeValue*> ReserveQueue;
+		ReserveQueue reserve_queue_;
+		typedef map<string,NodeValue*> Sources;
+		Sources sources_;
+		// ԴԤռʹõNodeValueճ
+		NodeValuePool value_pool_;
+		// ڵõͼʹñÿη
+		NodeValueView* node_view_;
+		// ڵwatch·->watchģڵ뿪бʱɾ
+		typedef map<string,uintptr_t> NodeWatches;
+		NodeWatches node_watches_;
+		// ޸sources_reserve_queue_value_pool_node_watches_ʱmutex_֮ٳд
+		// ֻĲѯGetCacheStatsֻжᱻصдʱܵûص
+		ZkRwLock cache_lock_;
+		// ǰգֻPublishSnapshot滻滻ȡգãʱsnapshot_mutex_ʱܶ
+		SourceSnapshot* snapshot_;
+		pthread_mutex_t snapshot_mutex_;
+		// ϴη֮󻺴б仯snapshot_dirty_Ϊݱ仯Ľڵ
+		bool is_snapshot_dirty_;
+		set<string> snapshot_dirty_;
+		// δص½ڵ㣬ΪʱƳٷNڵʱؽNο
+		set<string> snapshot_loading_;
+
+		enum EmApplyState{ idle,applying };
+
+		bool is_inited_;
+		EmApplyState apply_state_;
+		ZkAtomicValue<ZkSystemState> system_state_;
+
+		int client_id_;
+		IZkApplyClient* parent_;
+
+		// ʹûỰеĹỰZkSessionPoolsession_context_ΪAttachʱ
+		bool is_shared_session_;
+		uintptr_t session_context_;
+		// clientԤռڵ㣬ỰʱϿҪԼɾ
+		set<string> own_reserves_;
+		// ԤռڵԶɾ->ʱ
+		typedef map<uintptr_t,uintptr_t> AutoDeletes;
+		AutoDeletes auto_deletes_;
+		// 봴ڵģ0
+		uintptr_t apply_context_;
+		// watchǰһڵ
+		string apply_pre_path_;
+		// ڵţʱһΣŶλã-1Ϊδ֪
+		int apply_seq_;
+		int apply_pos_;
+		// 볬ʱʱ
+		uintptr_t apply_timer_;
+		uintptr_t apply_timer_context_;
+
+		pthread_mutex_t mutex_;
+	};
+
+	/*
+		ע
+		λ䣨CONTEXT_SLAB_SIZEһ飩ֻ±ֱӶλ
+		zkݵcookie =  << CONTEXT_INDEX_BITS | ±꣬λÿʹʱ1
+		ڵĻصɾλѱãƥܾ
+		Ҳü̶λٺ˶cookieü0ʱ
+		DestoryֻȥעеãڻصʹõĲᱻͷţ
+		ͬʱͻ˵ϣʱժɾͻֻԼ
+		صȫڼͻ˲ᱻɾɾͻʱɾģ
+		ٵȴΪգʹЩĵĻصѽ
+		յպб·ڴ棬´CreateֱӸ
+	*/
+#define CONTEXT_INDEX_BITS	20
+#define CONTEXT_INDEX_MASK	( ( 1U << CONTEXT_INDEX_BITS ) - 1 )
+#define CONTEXT_SLAB_SIZE	1024
+#define CONTEXT_MAX_SLABS	( ( 1U << CONTEXT_INDEX_BITS ) / CONTEXT_SLAB_SIZE )
+// ĵޣֱͷ
+#define CONTEXT_IDLE_MAX	4096
+// ½ʱԤ·
+#define CONTEXT_PATH_RESERVE	128
+// ·ռó˳ȵĲŻؿб
+#define CONTEXT_PATH_KEEP	1024
+
+	struct ContextSlot
+	{
+		ContextSlot():cookie_(0),context_(NULL),refs_(0),generation_(0),index_(0),next_free_(0){}
+		// ǰЧcookie0ʾɾ
+		volatile uintptr_t cookie_;
+		Context* volatile context_;
+		// ע1ãÿʹõĻص1
+		volatile long refs_;
+		uintptr_t generation_;
+		unsigned index_;
+		// еһ±+10ʾ
+		unsigned next_free_;
+	};
+
+	//	 
+	// ĵʹãصcookieصȡ
+	// ҪƵʹĵģΪԱѭʹ
+	// ڲƵģصɾصɹҲҪɾ
+	class Context{
+	public:
+		static Context* Create( IZkRegisterClient::ZkRegisterClientImpl* register_client = 0, const char* path = "",  NodeID id = INVALID_ID )
+		{
+			ZkAutoLock lock( &Context::context_mutex_ );
+			Context* context = Alloc();
+			context->register_client_ = register_client;
+			context->path_.assign( path );
+			context->node_id_ = id;
+			Register( context );
+			return context;
+		}
+
+		static Context* Create( zhandle_t* zkhanlde = 0, IZkApplyClient::ZkApplyClientImpl* apply_client = 0, unsigned auto_delete_time = 0, const char* path = "", NodeType type = SourceNode)
+		{
+			ZkAutoLock lock( &Context::context_mutex_ );
+			Context* context = Alloc();
+			context->zkhanlde_ = zkhanlde;
+			context->apply_client_ = apply_client;
+			context->auto_delete_time_ = auto_delete_time;
+			context->path_.assign( path );
+			context->node_type_ = type;
+			Register( context );
+			return context;
+		}
+
+		static Context* Create( const Context* src_context )
+		{
+			if ( src_context == NULL )
+			{
+				return NULL;
+			}
+			ZkAutoLock lock( &Context::context_mutex_ );
+			Context* context = Alloc();
+			context->zkhanlde_ = src_context->zkhanlde_;
+			context->apply_client_ = src_context->apply_client_;
+			context->auto_delete_time_ = src_context->auto_delete_time_;
+			context->path_.assign( src_context->path_ );
+			context->node_type_ = src_context->node_type_;
+			context->register_client_ = src_context->register_client_;
+			context->node_id_ = src_context->node_id_;
+			Register( context );
+			return context;
+		}
+
+		static void Destory( Context* context )
+		{
+			if ( context == NULL )
+			{
+				return;
+			}
+			if ( context->context_id_ == 0 )
+			{
+				// עʧܵĲעУͻɾдϣ
+				ZkAutoLock lock( &Context::context_mutex_ );
+				Unlink( context );
+				Free( context );
+				return;
+			}
+			Destory( context->context_id_ );
+		}
+
+		static void Destory( uintptr_t index )
+		{
+			ContextSlot* slot = GetSlot( index );
+			// ֻһܰcookie0ظɾڵcookieֱӺ
+			if ( slot != NULL && index != 0 && ZK_ATOMIC_CAS_PTR( &slot->cookie_, index, 0 ) )
+			{
+				Unpin( slot );
+			}
+		}
+		static void Clear( IZkApplyClient::ZkApplyClientImpl* apply_client )
+		{
+			if ( apply_client != NULL )
+			{
+				Clear( apply_client->contexts_ );
+			}
+		}
+
+		static void Clear( IZkRegisterClient::ZkRegisterClientImpl* register_client )
+		{
+			if ( register_client != NULL )
+			{
+				Clear( register_client->contexts_ );
+			}
+		}
+
+		// ɾϵģȴеı
+		// غ󲻻иÿͻ˵Ļصڸÿͻ˵Ļصе
+		// ȴڼص½ĲcookieᱻãҲҪȴ
+		static void Clear( ContextList& contexts )
+		{
+			{
+				ZkAutoLock lock( &Context::context_mutex_ );
+				contexts.is_closing_ = true;
+				Context* context = contexts.head_;
+				while ( context != NULL )
+				{
+					// ûбõDestoryֱӻղժ
+					Context* next = context->next_;
+					Destory( context->context_id_ );
+					context = next;
+				}
+			}
+			// еһUnpinʱգʱReclaim֪ͨ
+			ZkAutoLock lock( &Context::context_mutex_ );
+			while ( contexts.count_ != contexts.orphan_count_ )
+			{
+				pthread_cond_wait( &Context::reclaim_cond_, &Context::context_mutex_ );
+			}
+		}
+
+		// ͷClear֮ʣµģûcookieģģֻڿͻʱ
+		static void FreeOrphans( ContextList& contexts )
+		{
+			ZkAutoLock lock( &Context::context_mutex_ );
+			while ( contexts.head_ != NULL )
+			{
+				Context* context = contexts.head_;
+				Unlink( context );
+				Free( context );
+			}
+		}
+
+		// ̶cookieӦĲλɹUnpin֮ǰĲᱻͷ
+		static ContextSlot* Pin( uintptr_t index )
+		{
+			ContextSlot* slot = GetSlot( index );
+			if ( slot == NULL || index == 0 )
+			{
+				return NULL;
+			}
+			// üΪ0˵Ѿգ
+			while ( true )
+			{
+				long refs = slot->refs_;
+				if ( refs <= 0 )
+				{
+					return NULL;
+				}
+				if ( ZK_ATOMIC_CAS( &slot->refs_, refs, refs + 1 ) )
+				{
+					break;
+				}
+			}
+			// ̶֮ٺ˶ԣλѾɾ
+			if ( slot->cookie_ != index )
+			{
+				Unpin( slot );
+				return NULL;
+			}
+			return slot;
+		}
+
+		static void Unpin( ContextSlot* slot )
+		{
+			if ( ZK_ATOMIC_DEC( &slot->refs_ ) == 0 )
+			{
+				Reclaim( slot );
+			}
+		}
+
+		static void FormatContext( Context* context )
+		{
+			if ( context == NULL )
+			{
+				return;
+			}
+			context->apply_client_ = 0;
+			context->register_client_ = 0;
+			context->node_type_ = SourceNode;
+			context->auto_delete_time_ = 0;
+			// clearͷڴ棬ʱ·
+			context->path_.clear();
+			context->node_id_ = INVALID_ID;
+			context->zkhanlde_ = 0;
+			context->context_id_ = 0;
+			context->owner_ = NULL;
+			context->prev_ = NULL;
+			context->next_ = NULL;
+			context->is_idle_ = true;
+		}
+
+		static void Print()
+		{
+			ZkAutoLock lock( &Context::context_mutex_ );
+			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS, "Context size = %u slots = %u idle = %u\n", used_count_, slot_count_, (unsigned)idle_contexts_.size() );
+		}
+
+	private:
+		static ContextSlot* GetSlot( uintptr_t index )
+		{
+			unsigned slot_index = (unsigned)( index & CONTEXT_INDEX_MASK );
+			ContextSlot* slab = slabs_[slot_index / CONTEXT_SLAB_SIZE];
+			if ( slab == NULL )
+			{
+				return NULL;
+			}
+			return &slab[slot_index % CONTEXT_SLAB_SIZE];
+		}
+
+		// ȴӿбȡֻڳcontext_mutex_ʱ
+		static Context* Alloc()
+		{
+			if ( idle_contexts_.empty() )
+			{
+				Context* context = new Context();
+				context->path_.reserve( CONTEXT_PATH_RESERVE );
+				return context;
+			}
+			Context* context = idle_contexts_.back();
+			idle_contexts_.pop_back();
+			context->is_idle_ = false;
+			return context;
+		}
+
+		// Żؿб޻·ռùֱͷţֻڳcontext_mutex_ʱ
+		static void Free( Context* context )
+		{
+			if ( idle_contexts_.size() >= CONTEXT_IDLE_MAX || context->path_.capacity() > CONTEXT_PATH_KEEP )
+			{
+				DEL_PTR( context );
+				return;
+			}
+			FormatContext( context );
+			idle_contexts_.push_back( context );
+		}
+
+		// λcookieλþͻɾʱcontext_id_Ϊ0
+		static void Register( Context* context )
+		{
+			ZkAutoLock lock( &Context::context_mutex_ );
+			ContextList* owner = GetOwner( context );
+			if ( owner != NULL && owner->is_closing_ )
+			{
+				// ֻҵϣɵߵDestoryͻͷ
+				context->context_id_ = 0;
+				Link( context, owner );
+				owner->orphan_count_++;
+				return;
+			}
+			if ( free_head_ == 0 && !Grow() )
+			{
+				ZkClientPrint( ZK_LOG_LVL_ERROR, "Context slots are exhausted size=%u\n", used_count_ );
+				context->context_id_ = 0;
+				return;
+			}
+			ContextSlot* slot = &slabs_[( free_head_ - 1 ) / CONTEXT_SLAB_SIZE][( free_head_ - 1 ) % CONTEXT_SLAB_SIZE];
+			free_head_ = slot->next_free_;
+			used_count_++;
+
+			uintptr_t generation = ++slot->generation_ << CONTEXT_INDEX_BITS;
+			if ( generation == 0 )
+			{
+				// ʱ0֤cookieΪ0
+				generation = ++slot->generation_ << CONTEXT_INDEX_BITS;
+			}
+			context->context_id_ = generation | slot->index_;
+			Link( context, owner );
+			slot->context_ = context;
+			slot->refs_ = 1;
+			ZK_MEMORY_BARRIER();
+			slot->cookie_ = context->context_id_;
+		}
+
+		static ContextList* GetOwner( Context* context )
+		{
+			if ( context->register_client_ != NULL )
+			{
+				return &context->register_client_->contexts_;
+			}
+			if ( context->apply_client_ != NULL )
+			{
+				return &context->apply_client_->contexts_;
+			}
+			return NULL;
+		}
+
+		// ҵͻ˵ͷֻڳcontext_mutex_ʱ
+		static void Link( Context* context, ContextList* owner )
+		{
+			if ( owner == NULL )
+			{
+				return;
+			}
+			context->owner_ = owner;
+			context->prev_ = NULL;
+			context->next_ = owner->head_;
+			if ( owner->head_ != NULL )
+			{
+				owner->head_->prev_ = context;
+			}
+			owner->head_ = context;
+			owner->count_++;
+		}
+
+		static void Unlink( Context* context )
+		{
+			ContextList* owner = context->owner_;
+			if ( owner == NULL )
+			{
+				return;
+			}
+			if ( context->prev_ != NULL )
+			{
+				context->prev_->next_ = context->next_;
+			}
+			else
+			{
+				owner->head_ = context->next_;
+			}
+			if ( context->next_ != NULL )
+			{
+				context->next_->prev_ = context->prev_;
+			}
+			owner->count_--;
+			if ( context->context_id_ == 0 )
+			{
+				owner->orphan_count_--;
+			}
+			context->owner_ = NULL;
+			context->prev_ = NULL;
+			context->next_ = NULL;
+		}
+
+		// һλֻڳcontext_mutex_ʱ
+		static bool Grow()
+		{
+			unsigned slab_index = slot_count_ / CONTEXT_SLAB_SIZE;
+			if ( slab_index >= CONTEXT_MAX_SLABS )
+			{
+				return false;
+			}
+			ContextSlot* slab = new ContextSlot[CONTEXT_SLAB_SIZE];
+			// 0Ųλʹã֤cookieΪ0
+			for ( unsigned i = CONTEXT_SLAB_SIZE; i > 0; i-- )
+			{
+				unsigned index = slot_count_ + i - 1;
+				slab[i - 1].index_ = index;
+				if ( index != 0 )
+				{
+					slab[i - 1].next_free_ = free_head_;
+					free_head_ = index + 1;
+				}
+			}
+			ZK_MEMORY_BARRIER();
+			slabs_[slab_index] = slab;
+			slot_count_ += CONTEXT_SLAB_SIZE;
+			return true;
+		}
+
+		// һͷʱժĺͲλ
+		static void Reclaim( ContextSlot* slot )
+		{
+			ZkAutoLock lock( &Context::context_mutex_ );
+			Context* context = slot->context_;
+			slot->context_ = NULL;
+			ContextList* owner = context->owner_;
+			Unlink( context );
+			Free( context );
+			if ( owner != NULL && owner->count_ == owner->orphan_count_ )
+			{
+				pthread_cond_broadcast( &Context::reclaim_cond_ );
+			}
+			slot->next_free_ = free_head_;
+			free_head_ = slot->index_ + 1;
+			used_count_--;
+		}
+
+		typedef vector<Context*> IdleContexts;
+		static IdleContexts idle_contexts_;
+		static ContextSlot* slabs_[CONTEXT_MAX_SLABS];
+		// ѷĲλ
+		static unsigned slot_count_;
+		// ʹõĲλ
+		static unsigned used_count_;
+		// вλͷ±+10ʾûпУ
+		static unsigned free_head_;
+	public:
+		static pthread_mutex_t context_mutex_;
+		// ͻ˵ȫʱ֪ͨClear
+		static pthread_cond_t reclaim_cond_;
+	public: // data
+		Context(): apply_client_(NULL),register_client_(NULL),node_type_(SourceNode),
+			node_id_(INVALID_ID),auto_delete_time_(0),path_(""),zkhanlde_(NULL),is_idle_(false),context_id_(0),
+			owner_(NULL),prev_(NULL),next_(NULL){}
+		IZkApplyClient::ZkApplyClientImpl* apply_client_;
+		IZkRegisterClient::ZkRegisterClientImpl* register_client_;
+		NodeType node_type_;
+		NodeID node_id_;
+		unsigned auto_delete_time_;
+		string path_;
+		zhandle_t* zkhanlde_;
+		bool is_idle_;
+		uintptr_t context_id_;
+		// ͻ˵
+		ContextList* owner_;
+		Context* prev_;
+		Context* next_;
+
+	};
+	Context::IdleContexts Context::idle_contexts_;
+	ContextSlot* Context::slabs_[CONTEXT_MAX_SLABS];
+	unsigned Context::slot_count_ = 0;
+	unsigned Context::used_count_ = 0;
+	unsigned Context::free_head_ = 0;
+	pthread_mutex_t Context::context_mutex_;
+	ZkAutoInit context_auto_init( &Context::context_mutex_ );
+	pthread_cond_t Context::reclaim_cond_;
+	ZkAutoInit reclaim_cond_auto_init( &Context::reclaim_cond_ );
+
+	ContextList::~ContextList()
+	{
+		Context::Clear( *this );
+		Context::FreeOrphans( *this );
+	}
+
+	// صнģʱ̶λʱͷ
+	// ڼ伴ʹ߳DestoryҲᱻգ·
+	class ContextRef
+	{
+	public:
+		explicit ContextRef( uintptr_t index ):slot_( Context::Pin( index ) ){}
+		~ContextRef()
+		{
+			if ( slot_ != NULL )
+			{
+				Context::Unpin( slot_ );
+			}
+		}
+		bool IsValid() const { return slot_ != NULL; }
+		const Context* Get() const { return slot_->context_; }
+		const Context* operator->() const { return slot_->context_; }
+	private:
+		ContextRef( const ContextRef& );
+		ContextRef& operator=( const ContextRef& );
+		ContextSlot* slot_;
+	};
+
+
+	struct ObjectInfo 
+	{
+		IZkRegisterClient* register_client_;
+		IZkApplyClient* apply_client_;
+	};
+
+	// ȫĶ
+	class IObjectContainer
+	{		
+	public:
+		static void AddObject( IZkRegisterClient* client )
+		{
+			ZkAutoLock lock( &IObjectContainer::mutex_ );
+			ObjectInfo object_info;
+			object_info.register_client_ = client;
+			objects_.push_back( object_info );
+		}
+		static void AddObject( IZkApplyClient* client )
+		{
+			ZkAutoLock lock( &IObjectContainer::mutex_ );
+			ObjectInfo object_info;
+			object_info.apply_client_ = client;
+			objects_.push_back( object_info );
+		}
+
+		static void Destory( IZkRegisterClient* client )
+		{
+			ZkAutoLock lock( &IObjectContainer::mutex_ );
+
+			Objects::iterator itr = objects_.begin();
+			while ( itr != objects_.end() )
+			{
+				if ( itr->register_client_ == client )
+				{
+					objects_.erase( itr );
+					return;
+				}
+				itr++;
+			}
+		}
+		static void Destory( IZkApplyClient* client )
+		{
+			ZkAutoLock lock( &IObjectContainer::mutex_ );
 
-			reserve_queue_path_ += reserve_queue_name;
-			apply_queue_path_ += apply_queue_name;	
+			Objects::iterator itr = objects_.begin();
+			while ( itr != objects_.end() )
+			{
+				if ( itr->apply_client_ == client )
+				{				
+					objects_.erase( itr );
+					return;
+				}
+				itr++;
+			}
+		}
 
-			reserve_list_watch_context_ = NULL;
-			apply_list_watch_context_ = NULL;
-			source_list_wath_context_ = NULL;
+	public:
+		static pthread_mutex_t mutex_;
+		typedef vector<ObjectInfo> Objects;
+		static Objects objects_;
+	};
 
-			reserve_node_watch_context_ = NULL;
-			apply_node_watch_context_ = NULL;
-			source_node_wath_context_ = NULL;
+	pthread_mutex_t IObjectContainer::mutex_;
+	vector<ObjectInfo> IObjectContainer::objects_;
+	ZkAutoInit auto_init_(&IObjectContainer::mutex_);
 
-			connect_context_ = NULL;
+	static unsigned long long GetTimeUs()
+	{
+#ifdef WIN32
+		LARGE_INTEGER freq, now;
+		QueryPerformanceFrequency( &freq );
+		QueryPerformanceCounter( &now );
+		return ( now.QuadPart / freq.QuadPart ) * 1000000 + ( now.QuadPart % freq.QuadPart ) * 1000000 / freq.QuadPart;
+#else
+		struct timeval now;
+		gettimeofday( &now, NULL );
+		return (unsigned long long)now.tv_sec * 1000000 + now.tv_usec;
+#endif
+	}
 
-			Init();
+	static void DetachValues( NodeValue** values, int len, vector<NodeValue*>& copies )
+	{
+		copies.resize( len );
+		for ( int i = 0; i < len; i++ )
+		{
+			copies[i] = values[i] == NULL ? NULL : values[i]->Detach();
 		}
+	}
 
-		virtual ~ZkApplyClientImpl(void)
+	DispatchTask::~DispatchTask()
+	{
+		for ( unsigned i = 0; i < values_.size(); i++ )
 		{
-			Disconnect();	
-			Init( false );
+			NodeValue::Destory( values_[i] );
 		}
-	public:
-		bool Connect( const char* host, int time_out = 10000 );
-		int Apply( unsigned time_out = 10000 );
-		int Disconnect();
-		ZkSystemState GetSystemState(){return system_state_;}
-	protected:
-		// ȡԤռбԴб
-		bool LoadSource();
-	protected:
-		// ȡб
-		bool GetApplyList();
-		// бͬʱжǷԴȨޣ
-		bool UpdateApplyList( int rc, const struct String_vector *strings );
-		// ǷѾеһλãԴȨޣ
-		bool IsFirstPos( const char* path,  const struct String_vector *strings );
-		// ûصѡԴ
-		bool DoChoice();
-		// ڵ
-		bool UpdateApplyNode( int rc, const char* path );
+		for ( unsigned i = 0; i < reserves_.size(); i++ )
+		{
+			NodeValue::Destory( reserves_[i] );
+		}
+		if ( param_.type == ApplySuccessCb )
+		{
+			NodeValue::Destory( param_.apply_success_param.reserve_value );
+		}
+	}
 
-		// ȡԴб
-		int GetSourceList();
-		// ȡԴڵϢ
-		int GetSourceNode( const char* path );
-		// Դб
-		int UpdateSourceList( int rc, const struct String_vector* strings );
-		// Դڵ
-		int UpdateSourceNode( int rc, const char *value, int value_len, const char* path );
-		// Դ»ص
-		void NotifySourceList();
+	void ZkDispatchQueue::SetEnable( bool is_enable )
+	{
+		ZkAutoLock lock( &ZkDispatcher::mutex_ );
+		is_enable_ = is_enable;
+		while ( !is_enable_ && is_scheduled_ )
+		{
+			pthread_cond_wait( &ZkDispatcher::idle_cond_, &ZkDispatcher::mutex_ );
+		}
+	}
 
-		// ȡԤռб
-		int GetReserveList();
-		// ȡԤռڵ
-		int GetReserveNode( const char* path );
-		// Ԥռб
-		int UpdateReserveList( int rc, const struct String_vector* strings );
-		// Ԥռڵ
-		int UpdateReserveNode( int rc, const char *value, int value_len, const char* path );
+	bool ZkDispatchQueue::Post( ZkCallback callback, const CallbackParam& param, IZkApplyClient::ZkApplyClientImpl* choice_client )
+	{
+		if ( callback == NULL )
+		{
+			return false;
+		}
+		ZkAutoLock lock( &ZkDispatcher::mutex_ );
+		// ֹͣблδִĻصʱУֱִл˳
+		if ( !is_enable_ || ( !ZkDispatcher::is_running_ && !( ZkDispatcher::is_stopping_ && is_scheduled_ ) ) )
+		{
+			return false;
+		}
+		// ƲָָݣNodeValueݲ
+		DispatchTask* task = new DispatchTask();
+		task->callback_ = callback;
+		task->param_ = param;
+		if ( param.type == SourceChangeCb )
+		{
+			DetachValues( param.source_change_param.values, param.source_change_param.len, task->values_ );
+			task->param_.source_change_param.values = task->values_.empty() ? NULL : &task->values_[0];
+		}
+		else if ( param.type == ApplySuccessCb )
+		{
+			DetachValues( param.apply_success_param.source_values, param.apply_success_param.source_len, task->values_ );
+			DetachValues( param.apply_success_param.reserve_values, param.apply_success_param.reserve_len, task->reserves_ );
+			task->param_.apply_success_param.source_values = task->values_.empty() ? NULL : &task->values_[0];
+			task->param_.apply_success_param.reserve_values = task->reserves_.empty() ? NULL : &task->reserves_[0];
+			task->choice_client_ = choice_client;
+		}
+		else if ( param.type == ApplyAckCb && param.apply_ack_param.full_path != NULL )
+		{
+			task->path_ = param.apply_ack_param.full_path;
+			task->param_.apply_ack_param.full_path = task->path_.c_str();
+		}
+		task->post_time_ = GetTimeUs();
 
-		// ڵĻص
-		static void ApplyNodeCB(int rc, const char *value, const void *data);
-		// бص
-		static void ApplyListNotifyCB(int rc,const struct String_vector *strings, const void *data);
-		// бıWatch
-		static void ApplyListChangeWatch(zhandle_t *zh, int type, int state, const char *path,void *watcherCtx);
-		// ڵıWatch
-		static void PreNodeChangeWatch(zhandle_t *zh, int type, int state, const char *path,void *watcherCtx);
+		if ( tail_ == NULL )
+		{
+			head_ = task;
+		}
+		else
+		{
+			tail_->next_ = task;
+		}
+		tail_ = task;
+		if ( !is_scheduled_ )
+		{
+			is_scheduled_ = true;
+			ZkDispatcher::ready_.push_back( this );
+			pthread_cond_signal( &ZkDispatcher::work_cond_ );
+		}
+		DispatchStats& stats = ZkDispatcher::stats_;
+		stats.queue_depth++;
+		if ( stats.queue_depth > stats.max_queue_depth )
+		{
+			stats.max_queue_depth = stats.queue_depth;
+		}
+		return true;
+	}
 
-		// бصڵֵ仯ص
-		static void ListNotifyCB(int rc,const struct String_vector *strings, const void *data);
-		// ڵص
-		static void NodeNotifyCB(int rc, const char *value, int value_len, const struct Stat *stat, const void *data);
-		// бWatch
-		static void ListChangeWatch(zhandle_t *zh, int type, int state, const char *path,void *watcherCtx);
-		// ڵWatch
-		static void NodeChangeWatch(zhandle_t *zh, int type, int state, const char *path,void *watcherCtx);
+	void ZkDispatchQueue::Close()
+	{
+		ZkAutoLock lock( &ZkDispatcher::mutex_ );
+		is_enable_ = false;
+		while ( head_ != NULL )
+		{
+			DispatchTask* task = head_;
+			head_ = task->next_;
+			DEL_PTR( task );
+			ZkDispatcher::stats_.queue_depth--;
+		}
+		tail_ = NULL;
+		if ( is_scheduled_ && !is_running_ )
+		{
+			ZkDispatcher::ready_.remove( this );
+			is_scheduled_ = false;
+		}
+		while ( is_running_ )
+		{
+			pthread_cond_wait( &ZkDispatcher::idle_cond_, &ZkDispatcher::mutex_ );
+		}
+	}
 
-	private:
-		// watch˵仯ʱ򣬸ǲԶɾ
-		// ԵΪ̶ģڷʹ
-		// ڲ˵ضصԿԼʱ
-		// ɾʱΪ
-		Context* reserve_list_watch_context_;
-		Context* apply_list_watch_context_;
-		Context* source_list_wath_context_;
+	bool ZkDispatcher::is_running_ = false;
+	bool ZkDispatcher::is_stopping_ = false;
+	vector<pthread_t> ZkDispatcher::threads_;
+	list<ZkDispatchQueue*> ZkDispatcher::ready_;
+	pthread_cond_t ZkDispatcher::work_cond_;
+	pthread_cond_t ZkDispatcher::idle_cond_;
+	DispatchStats ZkDispatcher::stats_;
+	pthread_mutex_t ZkDispatcher::mutex_;
+	ZkAutoInit dispatcher_auto_init( &ZkDispatcher::mutex_ );
 
-		Context* reserve_node_watch_context_;
-		Context* apply_node_watch_context_;
-		Context* source_node_wath_context_;
+#ifdef WIN32
+	unsigned __stdcall DispatchThread( void* arg )
+	{
+		ZkDispatcher::Run();
+		return 0;
+	}
+#else
+	void* DispatchThread( void* arg )
+	{
+		ZkDispatcher::Run();
+		return NULL;
+	}
+#endif
 
-		// context
-		Context* connect_context_;
+	bool ZkDispatcher::Start( unsigned thread_count )
+	{
+		ZkAutoLock lock( &mutex_ );
+		if ( is_running_ )
+		{
+			return true;
+		}
+		if ( is_stopping_ || thread_count == 0 || thread_count > DISPATCH_MAX_THREADS )
+		{
+			return false;
+		}
+		if ( threads_.capacity() == 0 )
+		{
+			// ֻʼһΣStopʱ
+			pthread_cond_init( &work_cond_, NULL );
+			pthread_cond_init( &idle_cond_, NULL );
+			threads_.reserve( DISPATCH_MAX_THREADS );
+		}
+		for ( unsigned i = 0; i < thread_count; i++ )
+		{
+			pthread_t thd;
+			if ( pthread_create( &thd, NULL, DispatchThread, NULL ) != 0 )
+			{
+				ZkClientPrint( ZK_LOG_LVL_ERROR, "create dispatch thread fail\n" );
+				break;
+			}
+			threads_.push_back( thd );
+		}
+		is_running_ = !threads_.empty();
+		stats_.thread_count = threads_.size();
+		return is_running_;
+	}
 
-	public:
-		static void ReserveNodeCreateCB(int rc, const char *value, const void *data);
-		static void VoidCB(int rc, const void *data){}
-		static void StatCB(int rc, const struct Stat *stat, const void *data){}
-		static void Watch(zhandle_t *zh, int type, int state, const char *path,void *watcherCtx);
-		IZkApplyClient* GetParent(){ return parent_; }
-	protected:		
-		void OnDisconnected();
-		void OnConnected();
-		void OnConnecting();
-	protected:
-		void EndApply();
+	void ZkDispatcher::Stop()
+	{
+		vector<pthread_t> threads;
+		{
+			ZkAutoLock lock( &mutex_ );
+			if ( !is_running_ || is_stopping_ )
+			{
+				return;
+			}
+			is_running_ = false;
+			is_stopping_ = true;
+			threads.swap( threads_ );
+			pthread_cond_broadcast( &work_cond_ );
+		}
+		// ִ߳беĻص˳
+		// ֹͣлصclientУPostΪ֮zkֱִ߳
+		for ( unsigned i = 0; i < threads.size(); i++ )
+		{
+			pthread_join( threads[i], NULL );
+		}
+		ZkAutoLock lock( &mutex_ );
+		is_stopping_ = false;
+		stats_.thread_count = 0;
+	}
 
-	protected:
-		void RemoveReserveNode( const char* path );
-		void RemoveSourceNode( const char* path );
+	void ZkDispatcher::GetStats( DispatchStats& stats )
+	{
+		ZkAutoLock lock( &mutex_ );
+		stats = stats_;
+	}
 
-	public:
-		bool Init( bool bInit = true );
-		void Print();
-	private:
-		ZkCallback callback_;
-		void* callback_context_;
-		zhandle_t* zkhandle_;
-		string apply_queue_path_;
-		string reserve_queue_path_;
-		string source_path_;
-		string res_type_;
-		string apply_path_;
+	void ZkDispatcher::Run()
+	{
+		pthread_mutex_lock( &mutex_ );
+		while ( true )
+		{
+			while ( ready_.empty() && !is_stopping_ )
+			{
+				pthread_cond_wait( &work_cond_, &mutex_ );
+			}
+			if ( ready_.empty() )
+			{
+				break;
+			}
+			ZkDispatchQueue* queue = ready_.front();
+			ready_.pop_front();
+			DispatchTask* task = queue->head_;
+			queue->head_ = task->next_;
+			if ( queue->head_ == NULL )
+			{
+				queue->tail_ = NULL;
+			}
+			queue->is_running_ = true;
 
-		typedef map<string,NodeValue*> ReserveQueue;
-		ReserveQueue reserve_queue_;
-		typedef map<string,NodeValue*> Sources;
-		Sources sources_;
+			unsigned long long latency = GetTimeUs() - task->post_time_;
+			stats_.queue_depth--;
+			stats_.dispatch_count++;
+			stats_.total_latency_us += latency;
+			if ( latency > stats_.max_latency_us )
+			{
+				stats_.max_latency_us = latency;
+			}
+			pthread_mutex_unlock( &mutex_ );
 
-		enum EmApplyState{ idle,applying };
+			task->callback_( &task->param_ );
+			if ( task->choice_client_ != NULL )
+			{
+				task->choice_client_->OnChoice( task->param_ );
+			}
+			DEL_PTR( task );
 
-		bool is_inited_;
-		EmApplyState apply_state_;
-		ZkSystemState system_state_;
+			pthread_mutex_lock( &mutex_ );
+			queue->is_running_ = false;
+			if ( queue->head_ != NULL )
+			{
+				// ҵĩβclientĻصᱻ
+				ready_.push_back( queue );
+			}
+			else
+			{
+				queue->is_scheduled_ = false;
+			}
+			pthread_cond_broadcast( &idle_cond_ );
+		}
+		pthread_mutex_unlock( &mutex_ );
+	}
 
-		int client_id_;
-		IZkApplyClient* parent_;
+	bool IZkDispatcher::Start( unsigned thread_count /* = 4 */ )
+	{
+		return ZkDispatcher::Start( thread_count );
+	}
 
-		pthread_mutex_t mutex_;
-	};
+	void IZkDispatcher::Stop()
+	{
+		ZkDispatcher::Stop();
+	}
 
-	typedef enum emNodeType{
-		ApplyNode,
-		ReserveNode,
-		SourceNode
-	}NodeType;
+	void IZkDispatcher::GetStats( DispatchStats& stats )
+	{
+		ZkDispatcher::GetStats( stats );
+	}
 
-	//	 
-	// ĵʹãصIDصȡ
-	// ҪƵʹĵģΪԱѭʹ
-	// ڲƵģصɾصɹҲҪɾ
-	class Context{
-	public:
-		static Context* Create( IZkRegisterClient::ZkRegisterClientImpl* register_client = 0, string path = "",  NodeID id = INVALID_ID )
+	int ZkEventLoop::Poll( zhandle_t* zh, int& fd, int& events, int& timeout )
+	{
+#ifdef THREADED
+		return ZAPIERROR;
+#else
+		if ( zh == NULL )
 		{
-			ZkAutoLock lock( &Context::context_mutex_ );
-			Context* context = new Context();
-			context->context_id_ = ++Context::context_idx_;
-			context->register_client_ = register_client;
-			context->path_ = path;
-			context->node_id_ = id;
-
-			contexts_[context->context_id_] = context;
-			return context;
+			return ZINVALIDSTATE;
+		}
+		int interest = 0;
+		struct timeval tv = { 0, 0 };
+#ifdef WIN32
+		SOCKET socket = INVALID_SOCKET;
+		int ret = zookeeper_interest( zh, &socket, &interest, &tv );
+		fd = ( socket == INVALID_SOCKET ) ? -1 : (int)socket;
+#else
+		fd = -1;
+		int ret = zookeeper_interest( zh, &fd, &interest, &tv );
+#endif
+		events = 0;
+		if ( interest & ZOOKEEPER_READ )
+		{
+			events |= zkPollRead;
+		}
+		if ( interest & ZOOKEEPER_WRITE )
+		{
+			events |= zkPollWrite;
 		}
+		// ȡⲻ1ʱ߿ת
+		timeout = tv.tv_sec * 1000 + ( tv.tv_usec + 999 ) / 1000;
+		return ret;
+#endif
+	}
 
-		static Context* Create( zhandle_t* zkhanlde = 0, IZkApplyClient::ZkApplyClientImpl* apply_client = 0, unsigned auto_delete_time = 0,string path = "", NodeType type = SourceNode)
+	int ZkEventLoop::Process( zhandle_t* zh, int events )
+	{
+#ifdef THREADED
+		return ZAPIERROR;
+#else
+		if ( zh == NULL )
 		{
-			ZkAutoLock lock( &Context::context_mutex_ );
-			Context* context = new Context();
-			context->context_id_ = ++Context::context_idx_;
-			context->zkhanlde_ = zkhanlde;
-			context->apply_client_ = apply_client;
-			context->auto_delete_time_ = auto_delete_time;
-			context->path_ = path;
-			context->node_type_ = type;
-
-			contexts_[context->context_id_] = context;
-
-			return context;
+			return ZINVALIDSTATE;
+		}
+		int interest = 0;
+		if ( events & zkPollRead )
+		{
+			interest |= ZOOKEEPER_READ;
+		}
+		if ( events & zkPollWrite )
+		{
+			interest |= ZOOKEEPER_WRITE;
+		}
+		is_processing_ = true;
+		int ret = zookeeper_process( zh, interest );
+		is_processing_ = false;
+		if ( closing_handle_ != NULL )
+		{
+			zookeeper_close( closing_handle_ );
+			closing_handle_ = NULL;
 		}
+		return ret;
+#endif
+	}
 
-		static Context* Create( Context* src_context )
+	int ZkEventLoop::Close( zhandle_t* zh )
+	{
+		if ( is_processing_ )
 		{
-			if ( src_context == NULL )
-			{
-				return NULL;
-			}
-			ZkAutoLock lock( &Context::context_mutex_ );
-			Context* context = new Context();
-			context->context_id_ = ++Context::context_idx_;			
-			context->zkhanlde_ = src_context->zkhanlde_;
-			context->apply_client_ = src_context->apply_client_;
-			context->auto_delete_time_ = src_context->auto_delete_time_;
-			context->path_ = src_context->path_;
-			context->node_type_ = src_context->node_type_;
-			context->register_client_ = src_context->register_client_;
-			context->node_id_ = src_context->node_id_;
+			closing_handle_ = zh;
+			return ZOK;
+		}
+		return zookeeper_close( zh );
+	}
 
-			contexts_[context->context_id_] = context;
+	ZkSessionPool::Sessions ZkSessionPool::sessions_;
+	ZkSessionPool::Hosts ZkSessionPool::hosts_;
+	uintptr_t ZkSessionPool::session_index_ = 0;
+	pthread_mutex_t ZkSessionPool::mutex_;
+	ZkAutoInit session_pool_auto_init( &ZkSessionPool::mutex_ );
 
-			return context;
+	zhandle_t* ZkSessionPool::Attach( const char* host, int time_out, watcher_fn fn, void* context, bool& is_connected )
+	{
+		ZkAutoLock lock( &mutex_ );
+		ZkSession::Watcher watcher;
+		watcher.fn_ = fn;
+		watcher.context_ = context;
+		Hosts::iterator itr = hosts_.find( host );
+		if ( itr != hosts_.end() )
+		{
+			ZkSession* session = itr->second;
+			if ( session->time_out_ != time_out )
+			{
+				ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"attach session%u host=%s time_out=%d ignored, session time_out=%d\n", 
+					(unsigned)session->id_, host, time_out, session->time_out_ );
+			}
+			session->watchers_.push_back( watcher );
+			is_connected = ( session->state_ == ZOO_CONNECTED_STATE );
+			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"attach session%u host=%s clients=%u\n", 
+				(unsigned)session->id_, host, (unsigned)session->watchers_.size() );
+			return session->handle_;
 		}
 
-		static void Destory( Context* context )
+		is_connected = false;
+		uintptr_t id = ++session_index_;
+		zhandle_t* zh = zookeeper_init( host, ZkSessionPool::Watch, time_out, 0, (void*)id, 0 );
+		if ( zh == NULL )
 		{
-			if ( context == NULL )
-			{
-				return;
-			}
-			ZkAutoLock lock( &Context::context_mutex_ );
-			Contexts::iterator itr = contexts_.find( context->context_id_ );
-			if ( itr != contexts_.end() )
-			{
-				DEL_PTR( itr->second );
-				contexts_.erase( itr );
-			}
+			return NULL;
 		}
+		ZkSession* session = new ZkSession();
+		session->host_ = host;
+		session->handle_ = zh;
+		session->id_ = id;
+		session->time_out_ = time_out;
+		session->state_ = 0;
+		session->watchers_.push_back( watcher );
+		sessions_[id] = session;
+		hosts_[host] = session;
+		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"create session%u host=%s\n", (unsigned)id, host );
+		return zh;
+	}
 
-		static void Destory( int index )
+	int ZkSessionPool::Detach( zhandle_t* zh, void* context )
+	{
+		ZkSession* session = NULL;
 		{
-			ZkAutoLock lock( &Context::context_mutex_ );
-			Contexts::iterator itr = contexts_.find( index );
-			if ( itr != contexts_.end() )
+			ZkAutoLock lock( &mutex_ );
+			Sessions::iterator itr = sessions_.begin();
+			while ( itr != sessions_.end() && itr->second->handle_ != zh )
 			{
-				DEL_PTR( itr->second );
-				contexts_.erase( itr );
+				itr++;
 			}
-		}
-		static void Clear( IZkApplyClient* apply_client )
-		{
-			if ( apply_client == NULL )
+			if ( itr == sessions_.end() )
 			{
-				return;
+				return ZBADARGUMENTS;
 			}
-			ZkAutoLock lock( &Context::context_mutex_ );
-			Contexts::iterator itr = contexts_.begin();
-			while ( itr != contexts_.end() )
+			session = itr->second;
+			vector<ZkSession::Watcher>& watchers = session->watchers_;
+			for ( unsigned i = 0; i < watchers.size(); i++ )
 			{
-				Context* context = itr->second;
-				IZkApplyClient::ZkApplyClientImpl* client = context->apply_client_;
-				if ( client != NULL )
-				{
-					if ( client->GetParent() == apply_client )
-					{
-						DEL_PTR( itr->second );
-						contexts_.erase( itr++ );
-					}	
-					else
-					{
-						itr++;
-					}
-				}
-				else
+				if ( watchers[i].context_ == context )
 				{
-					itr++;
+					watchers.erase( watchers.begin() + i );
+					break;
 				}
 			}
+			if ( !watchers.empty() )
+			{
+				return ZOK;
+			}
+			sessions_.erase( itr );
+			Hosts::iterator host_itr = hosts_.find( session->host_ );
+			if ( host_itr != hosts_.end() && host_itr->second == session )
+			{
+				hosts_.erase( host_itr );
+			}
 		}
+		// гرգرʱĻصٴνỰ
+		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"close session%u host=%s\n", (unsigned)session->id_, session->host_.c_str() );
+		int ret = zookeeper_close( zh );
+		DEL_PTR( session );
+		return ret;
+	}
+
+	unsigned ZkSessionPool::GetSessionCount()
+	{
+		ZkAutoLock lock( &mutex_ );
+		return sessions_.size();
+	}
 
-		static void Clear( IZkRegisterClient* register_client )
+	void ZkSessionPool::Watch( zhandle_t* zh, int type, int state, const char* path, void* watcherCtx )
+	{
+		vector<ZkSession::Watcher> watchers;
 		{
-			if ( register_client == NULL )
+			ZkAutoLock lock( &mutex_ );
+			Sessions::iterator itr = sessions_.find( (uintptr_t)watcherCtx );
+			if ( itr == sessions_.end() )
 			{
 				return;
 			}
-			ZkAutoLock lock( &Context::context_mutex_ );
-			Contexts::iterator itr = contexts_.begin();
-			while ( itr != contexts_.end() )
+			ZkSession* session = itr->second;
+			if ( type == ZOO_SESSION_EVENT )
 			{
-				Context* context = itr->second;
-				IZkRegisterClient::ZkRegisterClientImpl* client = context->register_client_;
-				if ( client != NULL )
+				session->state_ = state;
+				if ( state == ZOO_EXPIRED_SESSION_STATE || state == ZOO_AUTH_FAILED_STATE )
 				{
-					if ( client->GetParent() == register_client )
+					// ٷӵclientʹеclientϿر
+					Hosts::iterator host_itr = hosts_.find( session->host_ );
+					if ( host_itr != hosts_.end() && host_itr->second == session )
 					{
-						DEL_PTR( itr->second );
-						contexts_.erase( itr++ );
-					}		
-					else
-					{
-						itr++;
+						hosts_.erase( host_itr );
 					}
 				}
-				else
-				{
-					itr++;
-				}
 			}
+			watchers = session->watchers_;
 		}
-
-		static bool GetContext( unsigned int index, Context& context )
+		// гתclientڻصлϿDetach
+		for ( unsigned i = 0; i < watchers.size(); i++ )
 		{
-			ZkAutoLock lock( &Context::context_mutex_ );
-			Contexts::iterator itr = contexts_.find( index );
-			if ( itr != contexts_.end() )
-			{
-				context = *itr->second;
-				return true;
-			}
-			return false;
+			watchers[i].fn_( zh, type, state, path, watchers[i].context_ );
 		}
+	}
 
-		static void FormatContext( Context* context )
+	ZkTimer ZkTimerWheel::root_[TIMER_ROOT_SIZE];
+	ZkTimer ZkTimerWheel::levels_[TIMER_LEVELS][TIMER_LEVEL_SIZE];
+	ZkTimerWheel::Timers ZkTimerWheel::timers_;
+	uintptr_t ZkTimerWheel::timer_index_ = 0;
+	unsigned long long ZkTimerWheel::current_tick_ = 0;
+	bool ZkTimerWheel::is_running_ = false;
+	pthread_cond_t ZkTimerWheel::work_cond_;
+	pthread_mutex_t ZkTimerWheel::mutex_;
+	ZkAutoInit timer_wheel_auto_init( &ZkTimerWheel::mutex_ );
+
+#ifdef WIN32
+	unsigned __stdcall TimerThread( void* arg )
+	{
+		ZkTimerWheel::Run();
+		return 0;
+	}
+#else
+	void* TimerThread( void* arg )
+	{
+		ZkTimerWheel::Run();
+		return NULL;
+	}
+#endif
+
+	unsigned long long ZkTimerWheel::GetTick()
+	{
+		return GetTimeUs() / 1000 / TIMER_TICK_MS;
+	}
+
+	uintptr_t ZkTimerWheel::Add( unsigned delay_ms, TimerFunc func, uintptr_t arg )
+	{
+		ZkAutoLock lock( &mutex_ );
+		if ( !is_running_ )
 		{
-			if ( context == NULL )
+			pthread_cond_init( &work_cond_, NULL );
+			pthread_t thd;
+			if ( pthread_create( &thd, NULL, TimerThread, NULL ) != 0 )
 			{
-				return;
+				ZkClientPrint( ZK_LOG_LVL_ERROR, "create timer thread fail\n" );
+				return 0;
 			}
-			context->apply_client_ = 0;
-			context->register_client_ = 0;
-			context->node_type_ = SourceNode;
-			context->auto_delete_time_ = 0;
-			context->path_ = "";
-			context->zkhanlde_ = 0;
-			context->is_idle_ = true;
+			pthread_detach( thd );
+			is_running_ = true;
 		}
-
-		static void Print()
+		if ( timers_.empty() )
 		{
-			ZkAutoLock lock( &Context::context_mutex_ );
-			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS, "Context size = %d index = %d\n", contexts_.size(), context_idx_ );
+			// ʱΪգӵǰʱ¿ʼ̵߳ȴڼûƽ̶ȣ
+			current_tick_ = GetTick();
 		}
+		ZkTimer* timer = new ZkTimer();
+		timer->id_ = ++timer_index_;
+		timer->expires_ = current_tick_ + ( delay_ms + TIMER_TICK_MS - 1 ) / TIMER_TICK_MS;
+		timer->func_ = func;
+		timer->arg_ = arg;
+		Insert( timer );
+		timers_[timer->id_] = timer;
+		if ( timers_.size() == 1 )
+		{
+			pthread_cond_signal( &work_cond_ );
+		}
+		return timer->id_;
+	}
 
-		typedef map<unsigned int,Context*> Contexts;
-		static Contexts contexts_;
-		typedef list<Context*> IdleContexts;
-		static IdleContexts idle_contexts_;
-		static pthread_mutex_t context_mutex_;
-		static unsigned int context_idx_;
-	public: // data
-		Context(): apply_client_(NULL),register_client_(NULL),node_type_(SourceNode),
-			node_id_(INVALID_ID),auto_delete_time_(0),path_(""),zkhanlde_(NULL),context_id_(0){}
-		IZkApplyClient::ZkApplyClientImpl* apply_client_;
-		IZkRegisterClient::ZkRegisterClientImpl* register_client_;
-		NodeType node_type_;
-		NodeID node_id_;
-		unsigned auto_delete_time_;
-		string path_;
-		zhandle_t* zkhanlde_;
-		bool is_idle_;
-		unsigned int context_id_;
-
-	};
-	list<Context*> Context::idle_contexts_;
-	map<unsigned int,Context*> Context::contexts_;
-	pthread_mutex_t Context::context_mutex_;
-	unsigned int Context::context_idx_ = 0;
-	ZkAutoInit context_auto_init( &Context::context_mutex_ );
-
+	bool ZkTimerWheel::Cancel( uintptr_t timer_id )
+	{
+		ZkAutoLock lock( &mutex_ );
+		Timers::iterator itr = timers_.find( timer_id );
+		if ( itr == timers_.end() )
+		{
+			return false;
+		}
+		Unlink( itr->second );
+		DEL_PTR( itr->second );
+		timers_.erase( itr );
+		return true;
+	}
 
-	struct ObjectInfo 
+	unsigned ZkTimerWheel::GetCount()
 	{
-		IZkRegisterClient* register_client_;
-		IZkApplyClient* apply_client_;
-	};
+		ZkAutoLock lock( &mutex_ );
+		return timers_.size();
+	}
 
-	// ȫĶ
-	class IObjectContainer
-	{		
-	public:
-		static void AddObject( IZkRegisterClient* client )
+	void ZkTimerWheel::Insert( ZkTimer* timer )
+	{
+		unsigned long long ticks = timer->expires_ - current_tick_;
+		if ( ticks < TIMER_ROOT_SIZE )
 		{
-			ZkAutoLock lock( &IObjectContainer::mutex_ );
-			ObjectInfo object_info;
-			object_info.register_client_ = client;
-			objects_.push_back( object_info );
+			Link( &root_[timer->expires_ & ( TIMER_ROOT_SIZE - 1 )], timer );
+			return;
 		}
-		static void AddObject( IZkApplyClient* client )
+		if ( ticks > TIMER_MAX_TICKS )
 		{
-			ZkAutoLock lock( &IObjectContainer::mutex_ );
-			ObjectInfo object_info;
-			object_info.apply_client_ = client;
-			objects_.push_back( object_info );
+			timer->expires_ = current_tick_ + TIMER_MAX_TICKS;
+			ticks = TIMER_MAX_TICKS;
+		}
+		for ( unsigned level = 0; level < TIMER_LEVELS; level++ )
+		{
+			unsigned shift = TIMER_ROOT_BITS + level * TIMER_LEVEL_BITS;
+			if ( ticks < ( 1ULL << ( shift + TIMER_LEVEL_BITS ) ) || level + 1 == TIMER_LEVELS )
+			{
+				Link( &levels_[level][( timer->expires_ >> shift ) & ( TIMER_LEVEL_SIZE - 1 )], timer );
+				return;
+			}
 		}
+	}
 
-		static void Destory( IZkRegisterClient* client )
+	void ZkTimerWheel::Link( ZkTimer* head, ZkTimer* timer )
+	{
+		timer->prev_ = head->prev_;
+		timer->next_ = head;
+		head->prev_->next_ = timer;
+		head->prev_ = timer;
+	}
+
+	void ZkTimerWheel::Unlink( ZkTimer* timer )
+	{
+		timer->prev_->next_ = timer->next_;
+		timer->next_->prev_ = timer->prev_;
+		timer->prev_ = timer;
+		timer->next_ = timer;
+	}
+
+	unsigned ZkTimerWheel::Cascade( unsigned level )
+	{
+		unsigned index = (unsigned)( current_tick_ >> ( TIMER_ROOT_BITS + level * TIMER_LEVEL_BITS ) ) & ( TIMER_LEVEL_SIZE - 1 );
+		ZkTimer* head = &levels_[level][index];
+		while ( head->next_ != head )
 		{
-			ZkAutoLock lock( &IObjectContainer::mutex_ );
+			ZkTimer* timer = head->next_;
+			Unlink( timer );
+			Insert( timer );
+		}
+		return index;
+	}
 
-			Context::Clear( client );
+	void ZkTimerWheel::Run()
+	{
+		ZkTimer expired;
+		pthread_mutex_lock( &mutex_ );
+		while ( true )
+		{
+			while ( timers_.empty() )
+			{
+				pthread_cond_wait( &work_cond_, &mutex_ );
+			}
+			pthread_mutex_unlock( &mutex_ );
+#ifdef WIN32
+			Sleep( TIMER_TICK_MS );
+#else
+			usleep( TIMER_TICK_MS * 1000 );
+#endif
+			pthread_mutex_lock( &mutex_ );
 
-			Objects::iterator itr = objects_.begin();
-			while ( itr != objects_.end() )
+			// ǰʱΪֹп̶ȣ̱߳ӳʱ׷ϣ
+			unsigned long long now = GetTick();
+			while ( current_tick_ <= now && !timers_.empty() )
 			{
-				if ( itr->register_client_ == client )
+				unsigned index = (unsigned)current_tick_ & ( TIMER_ROOT_SIZE - 1 );
+				if ( index == 0 )
 				{
-					objects_.erase( itr );
-					return;
+					for ( unsigned level = 0; level < TIMER_LEVELS && Cascade( level ) == 0; level++ );
 				}
-				itr++;
+				ZkTimer* head = &root_[index];
+				while ( head->next_ != head )
+				{
+					ZkTimer* timer = head->next_;
+					Unlink( timer );
+					timers_.erase( timer->id_ );
+					Link( &expired, timer );
+				}
+				current_tick_++;
 			}
-		}
-		static void Destory( IZkApplyClient* client )
-		{
-			ZkAutoLock lock( &IObjectContainer::mutex_ );
 
-			Context::Clear( client );
-
-			Objects::iterator itr = objects_.begin();
-			while ( itr != objects_.end() )
+			while ( expired.next_ != &expired )
 			{
-				if ( itr->apply_client_ == client )
-				{				
-					objects_.erase( itr );
-					return;
-				}
-				itr++;
+				ZkTimer* timer = expired.next_;
+				Unlink( timer );
+				pthread_mutex_unlock( &mutex_ );
+				timer->func_( timer->arg_ );
+				DEL_PTR( timer );
+				pthread_mutex_lock( &mutex_ );
 			}
 		}
-
-	public:
-		static pthread_mutex_t mutex_;
-		typedef vector<ObjectInfo> Objects;
-		static Objects objects_;
-	};
-
-	pthread_mutex_t IObjectContainer::mutex_;
-	vector<ObjectInfo> IObjectContainer::objects_;
-	ZkAutoInit auto_init_(&IObjectContainer::mutex_);
+		pthread_mutex_unlock( &mutex_ );
+	}
 
 	IZkRegisterClient* IZkRegisterClient::Create(ZkCallback callback, void* context /* = NULL */,
 		char* root_path /* = "/Resource" */, char* source_path /* = "/Source" */ )
@@ -912,8 +4228,14 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 	void IZkRegisterClient::Destory( IZkRegisterClient* client )
 	{
 		IObjectContainer::Destory( client );
-		
-		ZkAutoLock lock( &IObjectContainer::mutex_ );
+		if ( client != NULL )
+		{
+			// ȹرɷУɷApplySuccessCbģᴴԤռڵ㣩
+			// ٶϿٷµɾĲȴִеĻص
+			client->impl_->CloseDispatch();
+			client->impl_->DisConnect();
+			Context::Clear( client->impl_ );
+		}
 		DEL_PTR( client );
 	}
 
@@ -953,6 +4275,34 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 		return impl_->GetSystemState();
 	}
 
+	void IZkRegisterClient::SetDispatch( bool is_enable )
+	{
+		impl_->SetDispatch( is_enable );
+	}
+
+	void IZkRegisterClient::SetSharedSession( bool is_enable )
+	{
+		impl_->SetSharedSession( is_enable );
+	}
+
+	int IZkRegisterClient::Poll( int& fd, int& events, int& timeout )
+	{
+		return impl_->Poll( fd, events, timeout );
+	}
+
+	int IZkRegisterClient::Process( int events )
+	{
+		return impl_->Process( events );
+	}
+
+	void IZkRegisterClient::ZkRegisterClientImpl::Notify( CallbackParam& param )
+	{
+		if ( !dispatch_queue_.Post( callback_, param ) )
+		{
+			callback_( &param );
+		}
+	}
+
 	void IZkRegisterClient::Print()
 	{
 		impl_->Print();
@@ -962,7 +4312,9 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 	{
 		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS, "============ register client info begin ============\n" );
 		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS, "source path = %s\n",source_path_.c_str() );
-		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS, "system state = %d\n",system_state_ );
+		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS, "system state = %d\n", (int)system_state_.Load() );
+		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS, "contexts = %u\n",contexts_.count_ );
+		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"shared session = %d sessions = %u\n", (int)is_shared_session_, ZkSessionPool::GetSessionCount() );
 		Nodes::iterator itr = nodes_.begin();
 		while ( itr != nodes_.end() )
 		{
@@ -1014,12 +4366,21 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 			return false;
 		}
 		
-		if ( connect_context_ == NULL )
+		if ( connect_context_ == 0 )
 		{
-			connect_context_ = Context::Create( this );
+			connect_context_ = Context::Create( this )->context_id_;
 		}
 
-		zkhandle_ = zookeeper_init( host, IZkRegisterClient::ZkRegisterClientImpl::Watch, time_out, 0, (void*)connect_context_->context_id_, 0 );
+		bool is_connected = false;
+		if ( is_shared_session_ )
+		{
+			session_context_ = connect_context_;
+			zkhandle_ = ZkSessionPool::Attach( host, time_out, IZkRegisterClient::ZkRegisterClientImpl::Watch, (void*)session_context_, is_connected );
+		}
+		else
+		{
+			zkhandle_ = zookeeper_init( host, IZkRegisterClient::ZkRegisterClientImpl::Watch, time_out, 0, (void*)connect_context_, 0 );
+		}
 		if ( zkhandle_ != NULL )
 		{
 			system_state_ = zkConnecting;
@@ -1027,25 +4388,49 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 		else
 		{
 			Context::Destory( connect_context_ );
-			connect_context_ = NULL;
+			connect_context_ = 0;
 		}
 		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"init zookeeper zkhandle=%d\n", zkhandle_ );
+		if ( is_connected )
+		{
+			// ĻỰѾӣ¼
+			Watch( zkhandle_, ZOO_SESSION_EVENT, ZOO_CONNECTED_STATE, "", (void*)connect_context_ );
+		}
 		return (zkhandle_!=NULL);
 	}
 
+	void IZkRegisterClient::ZkRegisterClientImpl::SetSharedSession( bool is_enable )
+	{
+#ifdef THREADED
+		is_shared_session_ = is_enable;
+#endif
+	}
+
+	int IZkRegisterClient::ZkRegisterClientImpl::Poll( int& fd, int& events, int& timeout )
+	{
+		ZkAutoLock lock( &mutex_ );
+		return event_loop_.Poll( zkhandle_, fd, events, timeout );
+	}
+
+	int IZkRegisterClient::ZkRegisterClientImpl::Process( int events )
+	{
+		ZkAutoLock lock( &mutex_ );
+		return event_loop_.Process( zkhandle_, events );
+	}
+
 	bool IZkRegisterClient::ZkRegisterClientImpl::ReConnect( const char* host, int time_out /* = 10000 */ )
 	{
 		if ( zkhandle_ != NULL )
 		{
-			zookeeper_close( zkhandle_ );
+			event_loop_.Close( zkhandle_ );
 		}
 
-		if ( connect_context_ == NULL )
+		if ( connect_context_ == 0 )
 		{
-			connect_context_ = Context::Create( this );
+			connect_context_ = Context::Create( this )->context_id_;
 		}
 
-		zkhandle_ = zookeeper_init( host, IZkRegisterClient::ZkRegisterClientImpl::Watch, time_out, 0, (void*)connect_context_->context_id_, 0 );
+		zkhandle_ = zookeeper_init( host, IZkRegisterClient::ZkRegisterClientImpl::Watch, time_out, 0, (void*)connect_context_, 0 );
 		if ( zkhandle_ != NULL )
 		{
 			system_state_ = zkReConnecting;
@@ -1053,7 +4438,7 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 		else
 		{
 			Context::Destory( connect_context_ );
-			connect_context_ = NULL;
+			connect_context_ = 0;
 		}
 		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"zookeeper reconnecting\n" );
 		return (zkhandle_!=NULL);
@@ -1066,17 +4451,47 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 
 	int IZkRegisterClient::ZkRegisterClientImpl::DisConnect()
 	{
-		ZkAutoLock lock( &mutex_ );
-		system_state_ = zkDisconnect;
-		RemoveAllNode();
-		if ( zkhandle_ != NULL )
+		zhandle_t* zkhandle = NULL;
+		bool is_shared_session = false;
 		{
+			ZkAutoLock lock( &mutex_ );
+			system_state_ = zkDisconnect;
+			if ( zkhandle_ != NULL && is_shared_session_ )
+			{
+				// ỰԱclientʹãɾclientעʱڵ
+				for ( Nodes::iterator itr = nodes_.begin(); itr != nodes_.end(); itr++ )
+				{
+					if ( itr->second->IsCreated() )
+					{
+						zoo_adelete( zkhandle_, itr->second->GetPath(), -1, IZkRegisterClient::ZkRegisterClientImpl::VoidCB, NULL );
+					}
+				}
+			}
+			RemoveAllNode();
+			if ( zkhandle_ == NULL )
+			{
+				return -1;
+			}
 			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"close zookeeper\n" );
-			int ret = zookeeper_close( zkhandle_ );
+			zkhandle = zkhandle_;
 			zkhandle_ = NULL;
-			return ret;
+			is_shared_session = is_shared_session_;
+#ifndef THREADED
+			// ̵߳ľҪProcess⣬ڹر
+			return CloseHandle( zkhandle, is_shared_session );
+#endif
 		}
-		return -1;
+		// ̰߳汾zookeeper_closeȴص̣߳صڵȴ2ر
+		return CloseHandle( zkhandle, is_shared_session );
+	}
+
+	int IZkRegisterClient::ZkRegisterClientImpl::CloseHandle( zhandle_t* zkhandle, bool is_shared_session )
+	{
+		if ( is_shared_session )
+		{
+			return ZkSessionPool::Detach( zkhandle, (void*)session_context_ );
+		}
+		return event_loop_.Close( zkhandle );
 	}
 
 	int IZkRegisterClient::ZkRegisterClientImpl::Register( const char* res, NodeValue* value, NodeID& id )
@@ -1084,16 +4499,14 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 		ZkAutoLock lock( &mutex_ );
 		if ( system_state_ != zkConnected )
 		{
-			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"Register is fail system_state_=%d\n", system_state_);
+			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"Register is fail system_state_=%d\n", (int)system_state_.Load() );
 			return -1;
 		}
 
-		int len = MAX_BUFF;
-		char buffer[MAX_BUFF];
-		bool serialize_result = value->Serialize( buffer, len );
-		if ( serialize_result == false )
+		SerializeBuffer buffer;
+		if ( !buffer.Serialize( value ) )
 		{
-			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"Register is fail buff too long length=%d\n", MAX_BUFF);
+			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"Register is fail buff too long length=%d\n", value->GetSerializedSize() );
 			return -1;
 		}
 
@@ -1107,7 +4520,7 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 		id = ++index_;
 		Context* context = Context::Create( this, res, id );// = new Context( this, res, id );
 
-		int ret = zoo_acreate( zkhandle_, path.c_str(), buffer, len, &ZOO_OPEN_ACL_UNSAFE, 
+		int ret = zoo_acreate( zkhandle_, path.c_str(), buffer.GetData(), buffer.GetLength(), &ZOO_OPEN_ACL_UNSAFE, 
 			ZOO_EPHEMERAL|ZOO_SEQUENCE , IZkRegisterClient::ZkRegisterClientImpl::StringCB, (void*)context->context_id_ );
 
 		if ( ret == ZOK )
@@ -1132,7 +4545,7 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 		ZkAutoLock lock( &mutex_ );
 		if ( system_state_ != zkConnected )
 		{
-			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"Change is fail system_state_=%d\n", system_state_);
+			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"Change is fail system_state_=%d\n", (int)system_state_.Load() );
 			return -1;
 		}
 		
@@ -1141,17 +4554,21 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 		{
 			return -1;
 		}
-		int len = MAX_BUFF;
-		char buffer[MAX_BUFF];
-		bool serialize_result = value->Serialize( buffer, len );
-		if ( serialize_result == false )
+		// δ仯ʱд룬֪ͨж
+		if ( !node->IsNodeNeedUpdate() && value != NULL && node->GetValue()->GetFingerprint() == value->GetFingerprint() )
+		{
+			ZkClientPrint( ZK_LOG_LVL_DETAIL,"Change is skipped value not changed path= %s\n", node->GetPath() );
+			return ZOK;
+		}
+		SerializeBuffer buffer;
+		if ( !buffer.Serialize( value ) )
 		{
-			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"Change is fail buff too long length=%d\n", MAX_BUFF );
+			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"Change is fail buff too long length=%d\n", value->GetSerializedSize() );
 			return -1;
 		}
 
-		Context* context = Context::Create( this, node->GetPath() );
-		int ret = zoo_aset( zkhandle_, node->GetPath(), buffer, len, -1, IZkRegisterClient::ZkRegisterClientImpl::StatCB,(void*)context->context_id_ );
+		Context* context = Context::Create( this, node->GetPath(), id );
+		int ret = zoo_aset( zkhandle_, node->GetPath(), buffer.GetData(), buffer.GetLength(), -1, IZkRegisterClient::ZkRegisterClientImpl::StatCB,(void*)context->context_id_ );
 
 		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"Change source path= %s ret=%d\n", node->GetPath(), ret );
 		if ( ret != ZOK )
@@ -1161,6 +4578,7 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 		else
 		{
 			node->SetValue( value );
+			node->NodeNeedUpdate( false );
 		}
 
 		return ret;
@@ -1168,13 +4586,18 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 
 	int IZkRegisterClient::ZkRegisterClientImpl::Delete( NodeID& id )
 	{
+		ZkAutoLock lock( &mutex_ );
 		if ( system_state_ != zkConnected )
 		{
-			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS, "Delete is fail system_state_=%d\n", system_state_);
+			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS, "Delete is fail system_state_=%d\n", (int)system_state_.Load() );
 			return -1;
 		}
 		
 		NodeInfo* node = GetResInfo( id );
+		if ( node == NULL )
+		{
+			return -1;
+		}
 		Context* context = Context::Create( this, node->GetPath() );
 		int ret = zoo_adelete( zkhandle_, node->GetPath(), -1, IZkRegisterClient::ZkRegisterClientImpl::DeleteCB, (void*)context->context_id_ );
 
@@ -1207,25 +4630,24 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 	void IZkRegisterClient::ZkRegisterClientImpl::Watch(zhandle_t *zh, int type, int state, const char *path,void *watcherCtx)
 	{
 		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS, "Watch type = %d state=%d \n ", type, state );
-		ZkAutoLock lock( &IObjectContainer::mutex_ );
 		if ( type == ZOO_SESSION_EVENT )
 		{		
-			unsigned index = (unsigned int)(watcherCtx);
+			uintptr_t index = (uintptr_t)watcherCtx;
 
-			Context context;
-			if ( Context::GetContext( index, context ) )
+			ContextRef context( index );
+			if ( context.IsValid() )
 			{
 				if ( state == ZOO_CONNECTED_STATE )
 				{
-					context.register_client_->OnConnected();
+					context->register_client_->OnConnected();
 				}
 				else if ( state == ZOO_EXPIRED_SESSION_STATE )
 				{	
-					context.register_client_->OnDisconnected();
+					context->register_client_->OnDisconnected();
 				}
 				else if ( state == ZOO_CONNECTING_STATE )
 				{
-					context.register_client_->OnConnecting();
+					context->register_client_->OnConnecting();
 				}	
 			}		
 		}
@@ -1233,52 +4655,49 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 
 	void IZkRegisterClient::ZkRegisterClientImpl::StringCB(int rc, const char *value, const void *data)
 	{
-		ZkAutoLock lock( &IObjectContainer::mutex_ );
-		unsigned index = (unsigned int)(data);
-		Context context;
-		if ( !Context::GetContext( index, context ) )
+		uintptr_t index = (uintptr_t)data;
+		ContextRef context( index );
+		if ( !context.IsValid() )
 		{
 			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS," StringCB context is null\n" );
 			return ;
 		}
 
-		context.register_client_->OnRegisterRsp( rc, value, context.node_id_ );
-		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"register callback rc=%d path=%s id=%d\n", rc, value,context.node_id_ );
+		context->register_client_->OnRegisterRsp( rc, value, context->node_id_ );
+		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"register callback rc=%d path=%s id=%d\n", rc, value,context->node_id_ );
 		
 		Context::Destory(index);	
 	}
 
 	void IZkRegisterClient::ZkRegisterClientImpl::DeleteCB(int rc, const void *data)
 	{
-		ZkAutoLock lock( &IObjectContainer::mutex_ );
 
-		unsigned index = (unsigned int)(data);
-		Context context;
-		if ( !Context::GetContext( index, context ) )
+		uintptr_t index = (uintptr_t)data;
+		ContextRef context( index );
+		if ( !context.IsValid() )
 		{
 			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS," DeleteCB context is null\n" );
 			return;
 		}		
 		
-		context.register_client_->OnDeleteRsp( rc, context.path_.c_str(),context.node_id_ );
-		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"delete callback rc=%d path=%s id=%d\n", rc, context.path_.c_str(),context.node_id_ );
+		context->register_client_->OnDeleteRsp( rc, context->path_.c_str(),context->node_id_ );
+		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"delete callback rc=%d path=%s id=%d\n", rc, context->path_.c_str(),context->node_id_ );
 		
 		Context::Destory(index);			
 	}
 
 	void IZkRegisterClient::ZkRegisterClientImpl::StatCB(int rc, const struct Stat *stat, const void *data )
 	{
-		ZkAutoLock lock( &IObjectContainer::mutex_ );
-		unsigned index = (unsigned int)(data);
-		Context context;
-		if ( !Context::GetContext( index, context ) )
+		uintptr_t index = (uintptr_t)data;
+		ContextRef context( index );
+		if ( !context.IsValid() )
 		{
 			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS," StatCB context is null\n" );
 			return;
 		}
 	
-		context.register_client_->OnChangeRsp( rc, context.path_.c_str(), context.node_id_ );
-		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"change callback rc=%d path=%s id=%d\n", rc, context.path_.c_str(),context.node_id_ );
+		context->register_client_->OnChangeRsp( rc, context->path_.c_str(), context->node_id_ );
+		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"change callback rc=%d path=%s id=%d\n", rc, context->path_.c_str(),context->node_id_ );
 	
 		Context::Destory(index);	
 	}
@@ -1310,7 +4729,7 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 			param.result = rc;
 			param.register_param.id = id;
 			param.context = callback_context_;
-			callback_( &param );
+			Notify( param );
 		}
 	}
 
@@ -1325,6 +4744,15 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 		{
 			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS," OnChangeRsp rc=%d value=null id=%d\n", rc, id );
 		}
+		if ( rc != ZOK )
+		{
+			// 뱾زһ£´ChangeʹͬҲҪд
+			Nodes::iterator itr = nodes_.find( id );
+			if ( itr != nodes_.end() )
+			{
+				itr->second->NodeNeedUpdate( true );
+			}
+		}
 		if ( callback_ != NULL )
 		{
 			CallbackParam param;
@@ -1332,7 +4760,7 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 			param.result = rc;
 			param.register_param.id = id;
 			param.context = callback_context_;
-			callback_( &param );
+			Notify( param );
 		}
 	}
 
@@ -1355,7 +4783,7 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 			param.result = rc;
 			param.register_param.id = id;
 			param.context = callback_context_;
-			callback_( &param );
+			Notify( param );
 		}
 	}
 
@@ -1399,7 +4827,7 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 			}
 			param.result = 0;
 			param.context = callback_context_;
-			callback_( &param );
+			Notify( param );
 		}
 	}
 
@@ -1415,7 +4843,7 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 			param.type = ReConnectingCb;
 			param.result = 0;
 			param.context = callback_context_;
-			callback_( &param );
+			Notify( param );
 		}
 	}
 
@@ -1431,7 +4859,7 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 			param.type = DisconnectCb;
 			param.result = 0;
 			param.context = callback_context_;
-			callback_( &param );
+			Notify( param );
 		}
 	}
 
@@ -1473,7 +4901,14 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 	void IZkApplyClient::Destory( IZkApplyClient* client )
 	{
 		IObjectContainer::Destory( client );
-		ZkAutoLock lock( &IObjectContainer::mutex_ );
+		if ( client != NULL )
+		{
+			// ȹرɷУɷApplySuccessCbģᴴԤռڵ㣩
+			// ٶϿٷµɾĲȴִеĻص
+			client->impl_->CloseDispatch();
+			client->impl_->Disconnect();
+			Context::Clear( client->impl_ );
+		}
 		DEL_PTR( client );
 	}
 
@@ -1501,7 +4936,12 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 
 	int IZkApplyClient::Apply( int time_out /* = 10000 */ )
 	{
-		return impl_->Apply( time_out );
+		return impl_->Apply( time_out > 0 ? time_out : 0 );
+	}
+
+	int IZkApplyClient::CancelApply()
+	{
+		return impl_->CancelApply();
 	}
 
 	ZkSystemState IZkApplyClient::GetSystemState()
@@ -1519,13 +4959,167 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 		impl_->Print();
 	}
 
+	void IZkApplyClient::SetValuePool( bool is_enable )
+	{
+		impl_->SetValuePool( is_enable );
+	}
+
+	void IZkApplyClient::GetCacheStats( CacheStats& stats )
+	{
+		impl_->GetCacheStats( stats );
+	}
+
+	SourceSnapshot* IZkApplyClient::GetSourceSnapshot()
+	{
+		return impl_->GetSourceSnapshot();
+	}
+
+	void IZkApplyClient::SetDispatch( bool is_enable )
+	{
+		impl_->SetDispatch( is_enable );
+	}
+
+	void IZkApplyClient::SetSharedSession( bool is_enable )
+	{
+		impl_->SetSharedSession( is_enable );
+	}
+
+	int IZkApplyClient::Poll( int& fd, int& events, int& timeout )
+	{
+		return impl_->Poll( fd, events, timeout );
+	}
+
+	int IZkApplyClient::Process( int events )
+	{
+		return impl_->Process( events );
+	}
+
+	void IZkApplyClient::ZkApplyClientImpl::Notify( CallbackParam& param )
+	{
+		if ( !dispatch_queue_.Post( callback_, param ) )
+		{
+			callback_( &param );
+		}
+	}
+
+	void IZkApplyClient::ZkApplyClientImpl::SetValuePool( bool is_enable )
+	{
+		ZkAutoLock lock( &mutex_ );
+		ZkAutoWriteLock cache_lock( &cache_lock_ );
+		value_pool_.SetEnable( is_enable );
+	}
+
+	SourceSnapshot* IZkApplyClient::ZkApplyClientImpl::GetSourceSnapshot()
+	{
+		// ֻڼڼPublishSnapshot滻֮ɿñ֤Ч
+		ZkAutoLock lock( &snapshot_mutex_ );
+		snapshot_->AddRef();
+		return snapshot_;
+	}
+
+	void IZkApplyClient::ZkApplyClientImpl::PublishSnapshot()
+	{
+		if ( !is_snapshot_dirty_ || !snapshot_loading_.empty() )
+		{
+			return;
+		}
+		// ֻгmutex_̻߳滻snapshot_ȡҪ
+		const SourceSnapshot::SourceSnapshotImpl* old_impl = snapshot_->impl_;
+		SourceSnapshot* snapshot = new SourceSnapshot();
+		SourceSnapshot::SourceSnapshotImpl* impl = snapshot->impl_;
+		impl->version_ = old_impl->version_ + 1;
+		impl->sources_.reserve( sources_.size() );
+		unsigned pos = 0;
+		for ( Sources::iterator itr = sources_.begin(); itr != sources_.end(); itr++ )
+		{
+			if ( itr->second != NULL )
+			{
+				impl->sources_.push_back( GetSnapshotItem( old_impl->sources_, pos, itr->first, itr->second ) );
+			}
+		}
+		impl->reserves_.reserve( reserve_queue_.size() );
+		pos = 0;
+		for ( ReserveQueue::iterator itr = reserve_queue_.begin(); itr != reserve_queue_.end(); itr++ )
+		{
+			impl->reserves_.push_back( GetSnapshotItem( old_impl->reserves_, pos, itr->first, itr->second ) );
+		}
+		is_snapshot_dirty_ = false;
+		snapshot_dirty_.clear();
+
+		SourceSnapshot* old_snapshot = NULL;
+		{
+			ZkAutoLock lock( &snapshot_mutex_ );
+			old_snapshot = snapshot_;
+			snapshot_ = snapshot;
+		}
+		old_snapshot->Release();
+	}
+
+	SourceSnapshot::SourceSnapshotImpl::Item* IZkApplyClient::ZkApplyClientImpl::GetSnapshotItem( 
+		const SourceSnapshot::SourceSnapshotImpl::Items& items, unsigned& pos, const string& path, const NodeValue* value )
+	{
+		// պͻ涼·˳
+		while ( pos < items.size() && items[pos]->path_ < path )
+		{
+			pos++;
+		}
+		if ( pos < items.size() && items[pos]->path_ == path && snapshot_dirty_.find( path ) == snapshot_dirty_.end() )
+		{
+			items[pos]->AddRef();
+			return items[pos];
+		}
+		return new SourceSnapshot::SourceSnapshotImpl::Item( path, NodeValuePool::CreateCopy( value ) );
+	}
+
+	void IZkApplyClient::ZkApplyClientImpl::MarkSnapshot( const string& path )
+	{
+		is_snapshot_dirty_ = true;
+		snapshot_dirty_.insert( path );
+	}
+
+	void IZkApplyClient::ZkApplyClientImpl::RemoveLoading( const string& prefix )
+	{
+		set<string>::iterator itr = snapshot_loading_.lower_bound( prefix );
+		while ( itr != snapshot_loading_.end() && itr->compare( 0, prefix.size(), prefix ) == 0 )
+		{
+			snapshot_loading_.erase( itr++ );
+		}
+	}
+
+	void IZkApplyClient::ZkApplyClientImpl::GetCacheStats( CacheStats& stats )
+	{
+		// ֻжȴص
+		ZkAutoReadLock cache_lock( &cache_lock_ );
+		stats.source_count = sources_.size();
+		stats.reserve_count = reserve_queue_.size();
+		stats.pooled_count = value_pool_.GetCount();
+		stats.value_bytes = 0;
+		for ( Sources::iterator itr = sources_.begin(); itr != sources_.end(); itr++ )
+		{
+			stats.value_bytes += NodeValuePool::GetMemorySize( itr->second );
+		}
+		for ( ReserveQueue::iterator itr = reserve_queue_.begin(); itr != reserve_queue_.end(); itr++ )
+		{
+			stats.value_bytes += NodeValuePool::GetMemorySize( itr->second );
+		}
+		stats.pooled_bytes = value_pool_.GetMemorySize();
+		stats.watch_count = node_watches_.size();
+	}
+
 	void IZkApplyClient::ZkApplyClientImpl::Print()
 	{
 		ZkAutoLock lock( &mutex_ );
 		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS, "============ apply client info begin ============\n" );
 		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS, "source type = %s\n",res_type_.c_str() );
 		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS, "apply path = %s\n", apply_path_.c_str() );
-		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"system state = %d\n",system_state_ );
+		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"system state = %d\n", (int)system_state_.Load() );
+		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"contexts = %u\n",contexts_.count_ );
+		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"shared session = %d sessions = %u\n", (int)is_shared_session_, ZkSessionPool::GetSessionCount() );
+		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"auto delete = %u timers = %u\n", (unsigned)auto_deletes_.size(), ZkTimerWheel::GetCount() );
+		CacheStats stats;
+		GetCacheStats( stats );
+		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"cache source=%u reserve=%u bytes=%llu pooled=%u pooled bytes=%llu watch=%u\n",
+			stats.source_count, stats.reserve_count, stats.value_bytes, stats.pooled_count, stats.pooled_bytes, stats.watch_count );
 		
 		Sources::iterator itr = sources_.begin();
 		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS, "------------> source info\n" );
@@ -1577,12 +5171,21 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 			return false;
 		}
 
-		if ( connect_context_ == NULL )
+		if ( connect_context_ == 0 )
 		{
-			connect_context_ = Context::Create( zkhandle_, this );
+			connect_context_ = Context::Create( zkhandle_, this )->context_id_;
 		}
 
-		zkhandle_ = zookeeper_init( host, IZkApplyClient::ZkApplyClientImpl::Watch, time_out, 0, (void*)connect_context_->context_id_, 0 );
+		bool is_connected = false;
+		if ( is_shared_session_ )
+		{
+			session_context_ = connect_context_;
+			zkhandle_ = ZkSessionPool::Attach( host, time_out, IZkApplyClient::ZkApplyClientImpl::Watch, (void*)session_context_, is_connected );
+		}
+		else
+		{
+			zkhandle_ = zookeeper_init( host, IZkApplyClient::ZkApplyClientImpl::Watch, time_out, 0, (void*)connect_context_, 0 );
+		}
 		
 		if ( zkhandle_ != NULL )
 		{
@@ -1592,12 +5195,36 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 		else
 		{
 			Context::Destory( connect_context_ );
-			connect_context_ = NULL;
+			connect_context_ = 0;
 			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"cli%d connect zookeeper fail \n" ,client_id_);
 		}
+		if ( is_connected )
+		{
+			// ĻỰѾӣ¼
+			Watch( zkhandle_, ZOO_SESSION_EVENT, ZOO_CONNECTED_STATE, "", (void*)connect_context_ );
+		}
 		return ( zkhandle_ != NULL );	
 	}
 
+	void IZkApplyClient::ZkApplyClientImpl::SetSharedSession( bool is_enable )
+	{
+#ifdef THREADED
+		is_shared_session_ = is_enable;
+#endif
+	}
+
+	int IZkApplyClient::ZkApplyClientImpl::Poll( int& fd, int& events, int& timeout )
+	{
+		ZkAutoLock lock( &mutex_ );
+		return event_loop_.Poll( zkhandle_, fd, events, timeout );
+	}
+
+	int IZkApplyClient::ZkApplyClientImpl::Process( int events )
+	{
+		ZkAutoLock lock( &mutex_ );
+		return event_loop_.Process( zkhandle_, events );
+	}
+
 	bool IZkApplyClient::ZkApplyClientImpl::LoadSource()
 	{
 		if ( system_state_ != zkConnected  || zkhandle_ == NULL )
@@ -1619,7 +5246,7 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 		ZkAutoLock lock( &mutex_ );
 		if ( system_state_ != zkConnected || apply_state_ == applying || !is_inited_ )
 		{
-			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"cli%d Apply fail system_state=%d apply_state=% is_inited=%d\n" ,client_id_, system_state_, apply_state_, (int)is_inited_);
+			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"cli%d Apply fail system_state=%d apply_state=% is_inited=%d\n" ,client_id_, (int)system_state_.Load(), apply_state_, (int)is_inited_);
 			return -1;
 		}
 		
@@ -1633,6 +5260,25 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 		if ( ret == ZOK )
 		{
 			apply_state_ = applying;
+			apply_context_ = context->context_id_;
+			if ( time_out != 0 )
+			{
+				Context* timer_context = Context::Create( zkhandle_, this );
+				if ( timer_context->context_id_ != 0 )
+				{
+					apply_timer_ = ZkTimerWheel::Add( time_out, IZkApplyClient::ZkApplyClientImpl::ApplyTimer, timer_context->context_id_ );
+				}
+				if ( apply_timer_ != 0 )
+				{
+					apply_timer_context_ = timer_context->context_id_;
+				}
+				else
+				{
+					// ճУֻûгʱ
+					Context::Destory( timer_context );
+					ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"cli%d add apply timer fail\n", client_id_ );
+				}
+			}
 		}
 		else
 		{
@@ -1644,20 +5290,64 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 		return ret;
 	}
 
+	int IZkApplyClient::ZkApplyClientImpl::CancelApply()
+	{
+		ZkAutoLock lock( &mutex_ );
+		if ( apply_state_ != applying )
+		{
+			return -1;
+		}
+		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"cli%d cancel apply path=%s\n", client_id_, apply_path_.c_str() );
+		EndApply();
+		return ZOK;
+	}
+
+	void IZkApplyClient::ZkApplyClientImpl::ApplyTimer( uintptr_t index )
+	{
+		ContextRef context( index );
+		if ( context.IsValid() )
+		{
+			context->apply_client_->OnApplyTimeout( index );
+		}
+	}
+
+	void IZkApplyClient::ZkApplyClientImpl::OnApplyTimeout( uintptr_t index )
+	{
+		ZkAutoLock lock( &mutex_ );
+		if ( index != apply_timer_context_ )
+		{
+			// Ѿʱȡ
+			return;
+		}
+		apply_timer_ = 0;
+		apply_timer_context_ = 0;
+		Context::Destory( index );
+
+		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"cli%d apply timeout path=%s\n", client_id_, apply_path_.c_str() );
+		FailApply( ZOPERATIONTIMEOUT );
+	}
+
+	void IZkApplyClient::ZkApplyClientImpl::CancelApplyTimer()
+	{
+		if ( apply_timer_ != 0 )
+		{
+			ZkTimerWheel::Cancel( apply_timer_ );
+			Context::Destory( apply_timer_context_ );
+			apply_timer_ = 0;
+			apply_timer_context_ = 0;
+		}
+	}
+
 	bool IZkApplyClient::ZkApplyClientImpl::GetApplyList()
 	{
 		if ( system_state_ != zkConnected || apply_state_ != applying )
 		{
-			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"cli%d GetApplyList fail system_state=%d apply_state=% \n" ,client_id_, system_state_, apply_state_);
+			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"cli%d GetApplyList fail system_state=%d apply_state=% \n" ,client_id_, (int)system_state_.Load(), apply_state_);
 			return false;
 		}
+		// ֻȡһбwatchУÿ߽ỽеȴߣ
 		Context* context = Context::Create( zkhandle_, this );
-		if ( apply_list_watch_context_ == NULL )
-		{
-			apply_list_watch_context_ = Context::Create( zkhandle_, this );
-		}
-		int ret = zoo_awget_children( zkhandle_, apply_queue_path_.c_str(), IZkApplyClient::ZkApplyClientImpl::ApplyListChangeWatch, 
-			(void*)apply_list_watch_context_->context_id_, IZkApplyClient::ZkApplyClientImpl::ApplyListNotifyCB, (void*)context->context_id_ );
+		int ret = zoo_aget_children( zkhandle_, apply_queue_path_.c_str(), 0, IZkApplyClient::ZkApplyClientImpl::ApplyListNotifyCB, (void*)context->context_id_ );
 		
 		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"cli%d get apply list path=%s ret = %d\n", client_id_, apply_queue_path_.c_str(), ret );
 
@@ -1665,90 +5355,225 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 		{
 			Context::Destory( context );
 		}
-		return (ret != ZOK);
+		return (ret == ZOK);
 	}
 
 	bool IZkApplyClient::ZkApplyClientImpl::UpdateApplyList( int rc, const struct String_vector *strings )
 	{
 		ZkAutoLock lock( &mutex_ );
 		// state=applyingʱһֿapplyڵ㻹ûлظpath="" ʱҲܽд
+		// еĻظҲɹOnConnected»ȡб
 		if ( system_state_ != zkConnected || apply_state_ != applying || apply_path_ == "" )
 		{
-			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"cli%d UpdateApplyList fail system_state=%d apply_state=%d \n" ,client_id_, system_state_, apply_state_);
+			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"cli%d UpdateApplyList fail system_state=%d apply_state=%d \n" ,client_id_, (int)system_state_.Load(), apply_state_);
 			return false;
 		}
 		if ( rc == ZOK )
 		{
-			if ( IsFirstPos( apply_path_.c_str(), strings ) )
+			string pre_node;
+			bool is_first = IsFirstPos( strings, pre_node );
+			if ( is_first )
 			{
 				ZkClientPrint( ZK_LOG_LVL_KEYSTATUS, "cli%d client choose source path=%s\n", client_id_,apply_path_.c_str() );
 				return DoChoice();
 			}
+			if ( !WatchPreNode( apply_queue_path_ + "/" + pre_node ) )
+			{
+				FailApply( ZSYSTEMERROR );
+				return false;
+			}
+			return true;
+		}
+		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"cli%d get apply list fail rc=%d\n", client_id_, rc );
+		if ( rc == ZNONODE )
+		{
+			// ѲڣڵҲ֮ɾ
+			FailApply( rc );
+			return false;
 		}
+		// Ӵȣ»ȡ
+		ContinueApply( true );
 		return false;
 	}
 
-	bool IZkApplyClient::ZkApplyClientImpl::IsFirstPos( const char* path,  const struct String_vector *strings )
+	/*
+		˳ڵĩβţzk̶Ϊ10λʮ˳ڵ򳬳intΧʱfalse
+	*/
+	static bool ParseSequence( const char* name, int& seq )
 	{
-		if ( path == "" )
+		const int SEQUENCE_LEN = 10;
+		size_t len = strlen( name );
+		if ( len < SEQUENCE_LEN )
 		{
 			return false;
 		}
-		int size = res_type_.size() + reserve_queue_path_.size();
-		string path_nbr = path+size;
-		int nbr = atoi( path_nbr.c_str() );
-
-		for ( int i = 0; i < strings->count; i++ )
+		const char* digit = name + len - SEQUENCE_LEN;
+		// 10λܳintlong longۼ
+		long long value = 0;
+		for ( int i = 0; i < SEQUENCE_LEN; i++ )
 		{
-			string temp_str = strings->data[i] + res_type_.size();
-			int temp_nbr = atoi( temp_str.c_str() );
-			if ( temp_nbr < nbr )
+			if ( digit[i] < '0' || digit[i] > '9' )
 			{
 				return false;
 			}
+			value = value * 10 + ( digit[i] - '0' );
+		}
+		if ( value > INT_MAX )
+		{
+			return false;
 		}
+		seq = (int)value;
 		return true;
 	}
 
-	bool IZkApplyClient::ZkApplyClientImpl::UpdateApplyNode( int rc, const char* path )
+	bool IZkApplyClient::ZkApplyClientImpl::IsFirstPos( const struct String_vector *strings, string& pre_node )
+	{
+		// ŶλΪԼСĽڵǰһڵΪһ
+		int pos = 0;
+		int pre_index = -1;
+		int pre_seq = -1;
+		for ( int i = 0; i < strings->count; i++ )
+		{
+			int seq = 0;
+			if ( !ParseSequence( strings->data[i], seq ) || seq >= apply_seq_ )
+			{
+				continue;
+			}
+			pos++;
+			if ( seq > pre_seq )
+			{
+				pre_seq = seq;
+				pre_index = i;
+			}
+		}
+		if ( pre_index >= 0 )
+		{
+			pre_node = strings->data[pre_index];
+		}
+		if ( pos != apply_pos_ )
+		{
+			apply_pos_ = pos;
+			NotifyApplyAck();
+		}
+		return (pos == 0);
+	}
+
+	void IZkApplyClient::ZkApplyClientImpl::NotifyApplyAck()
+	{
+		if ( callback_ != NULL )
+		{
+			CallbackParam param;
+			param.type = ApplyAckCb;
+			param.result = ZOK;
+			param.context = callback_context_;
+			param.apply_ack_param.full_path = apply_path_.c_str();
+			param.apply_ack_param.index = apply_seq_;
+			param.apply_ack_param.position = apply_pos_;
+			Notify( param );
+		}
+	}
+
+	bool IZkApplyClient::ZkApplyClientImpl::WatchPreNode( const string& pre_path )
+	{
+		apply_pre_path_ = pre_path;
+
+		if ( apply_node_watch_context_ == 0 )
+		{
+			apply_node_watch_context_ = Context::Create( zkhandle_, this )->context_id_;
+		}
+		Context* context = Context::Create( zkhandle_, this, 0, apply_pre_path_.c_str(), ApplyNode );
+		int ret = zoo_awexists( zkhandle_, apply_pre_path_.c_str(), IZkApplyClient::ZkApplyClientImpl::PreNodeChangeWatch, 
+			(void*)apply_node_watch_context_, IZkApplyClient::ZkApplyClientImpl::PreNodeExistsCB, (void*)context->context_id_ );
+
+		ZkClientPrint( ZK_LOG_LVL_DETAIL,"cli%d watch pre apply node path=%s ret=%d\n", client_id_, apply_pre_path_.c_str(), ret );
+
+		if ( ret != ZOK )
+		{
+			Context::Destory( context );
+		}
+		return (ret == ZOK);
+	}
+
+	void IZkApplyClient::ZkApplyClientImpl::UpdatePreNode( int rc, const char* path )
 	{
 		ZkAutoLock lock( &mutex_ );
+		// ֻǰwatchĽڵ㣬֮ǰµwatchֱӺ
+		if ( apply_state_ != applying || apply_pre_path_ != path )
+		{
+			return;
+		}
+		// ڵȻʱȴwatchѾڣwatchǰɾʱ»ȡб
+		// Ӵʱڵ״̬δ֪ܵɾwatch
+		if ( rc == ZOK )
+		{
+			return;
+		}
+		ContinueApply( rc == ZNONODE );
+	}
+
+	void IZkApplyClient::ZkApplyClientImpl::UpdatePreNodeEvent( int type, const char* path )
+	{
+		ZkAutoLock lock( &mutex_ );
+		if ( apply_state_ != applying || apply_pre_path_ != path )
+		{
+			return;
+		}
+		// ɾʱ»ȡб¼ڵݱ޸ģwatchҪ
+		ContinueApply( type == ZOO_DELETED_EVENT );
+	}
+
+	void IZkApplyClient::ZkApplyClientImpl::ContinueApply( bool is_pre_deleted )
+	{
+		string pre_path = apply_pre_path_;
+		apply_pre_path_ = "";
+		if ( system_state_ != zkConnected )
+		{
+			// ɹOnConnected»ȡб
+			return;
+		}
+		bool ret = is_pre_deleted ? GetApplyList() : WatchPreNode( pre_path );
+		if ( !ret )
+		{
+			FailApply( ZSYSTEMERROR );
+		}
+	}
+
+	bool IZkApplyClient::ZkApplyClientImpl::UpdateApplyNode( uintptr_t index, int rc, const char* path )
+	{
+		ZkAutoLock lock( &mutex_ );
+		if ( zkhandle_ == NULL )
+		{
+			return false;
+		}
+		if ( index != apply_context_ )
+		{
+			// ڵ㴴ظǰѳʱȡɾٵڵ
+			if ( rc == ZOK )
+			{
+				int ret = zoo_adelete( zkhandle_, path, -1, IZkApplyClient::ZkApplyClientImpl::VoidCB, NULL );
+				ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"cli%d delete stale apply node path=%s ret=%d\n", client_id_, path, ret );
+			}
+			return false;
+		}
 		if ( rc == ZOK )
 		{
 			apply_path_ = path;
-			bool bRet = GetApplyList();
-			
-			if ( callback_ != NULL )
-			{
-				CallbackParam param;
-				param.type = ApplyAckCb;
-				param.result = rc;
-				param.context = callback_context_;
-				param.apply_ack_param.full_path = path;
-
-				int size = res_type_.size() + reserve_queue_path_.size();
-				string path_nbr = path + size;
-				int nbr = atoi( path_nbr.c_str() );
+			apply_seq_ = 0;
+			apply_pos_ = -1;
+			ParseSequence( path, apply_seq_ );
+			NotifyApplyAck();
 
-				param.apply_ack_param.index = nbr;
-
-				callback_( &param );
+			// OnConnected»ȡб
+			if ( system_state_ == zkConnected && !GetApplyList() )
+			{
+				FailApply( ZSYSTEMERROR );
+				return false;
 			}
-
-			return bRet;
+			return true;
 		}
 		else
 		{
-			EndApply();
-	
-			if ( callback_ != NULL )
-			{
-				CallbackParam param;
-				param.type = ApplyFailCb;
-				param.result = rc;
-				param.context = callback_context_;
-				callback_( &param );
-			}
+			FailApply( rc );
 		}
 		return false;
 	}
@@ -1784,7 +5609,11 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 			}
 
 			//unsigned auto_delete_time = 0;
-			NodeValue* value = NodeValue::Create();
+			NodeValue* value = NULL;
+			{
+				ZkAutoWriteLock cache_lock( &cache_lock_ );
+				value = value_pool_.Create();
+			}
 			CallbackParam param;
 			param.type = ApplySuccessCb;
 			param.apply_success_param.source_values = source_buffer;
@@ -1796,46 +5625,58 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 			param.apply_success_param.has_choosed = false;
 			param.context = callback_context_;
 			
-			callback_( &param );
-
-// 			bool ret = arbitration_callback_( source_buffer, source_size, reserve_buffer, 
-// 				reserve_size, *value, auto_delete_time, callback_context_ );
-			
-			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"cli%d user's choice is %d auto_delete=%d \n",client_id_, param.apply_success_param.has_choosed, param.apply_success_param.auto_delete_time );
-			if ( param.apply_success_param.has_choosed )
+			// ɷʱصOnChoiceڹִ߳Уvalueɷͷ
+			if ( !dispatch_queue_.Post( callback_, param, this ) )
 			{
-				Context* context = Context::Create( zkhandle_, this, param.apply_success_param.auto_delete_time );
-				string path = reserve_queue_path_;
-				path += "/";
-				path += res_type_;
-
-				int len = MAX_BUFF;
-				char buffer[MAX_BUFF];
-				bool bRet = value->Serialize( buffer, len );
+				callback_( &param );
 
-				// Ԥռ
-				int ret = zoo_acreate( zkhandle_, path.c_str(), buffer, len, &ZOO_OPEN_ACL_UNSAFE, ZOO_SEQUENCE|ZOO_EPHEMERAL, 
-					IZkApplyClient::ZkApplyClientImpl::ReserveNodeCreateCB, (void*)context->context_id_ );
+// 				bool ret = arbitration_callback_( source_buffer, source_size, reserve_buffer, 
+// 					reserve_size, *value, auto_delete_time, callback_context_ );
 
-				if ( ret != ZOK )
-				{
-					Context::Destory(context);
-				}
-				ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"cli%d create reserve node path=%s ret=%d \n",client_id_, path.c_str(), ret );
+				OnChoice( param );
+				ZkAutoWriteLock cache_lock( &cache_lock_ );
+				value_pool_.Destory( value );
 			}
 			DEL_PTR_ARRAY(reserve_buffer)
 			DEL_PTR_ARRAY(source_buffer)
-			NodeValue::Destory( value );
 		}				
 		return true;
 	}
 
+	void IZkApplyClient::ZkApplyClientImpl::OnChoice( CallbackParam& param )
+	{
+		ZkAutoLock lock( &mutex_ );
+		NodeValue* value = param.apply_success_param.reserve_value;
+		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"cli%d user's choice is %d auto_delete=%d \n",client_id_, param.apply_success_param.has_choosed, param.apply_success_param.auto_delete_time );
+		SerializeBuffer buffer;
+		if ( param.apply_success_param.has_choosed && !buffer.Serialize( value ) )
+		{
+			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"cli%d reserve value too long length=%d\n",client_id_, value->GetSerializedSize() );
+		}
+		else if ( param.apply_success_param.has_choosed )
+		{
+			Context* context = Context::Create( zkhandle_, this, param.apply_success_param.auto_delete_time );
+			string path = reserve_queue_path_;
+			path += "/";
+			path += res_type_;
+
+			// Ԥռ
+			int ret = zoo_acreate( zkhandle_, path.c_str(), buffer.GetData(), buffer.GetLength(), &ZOO_OPEN_ACL_UNSAFE, ZOO_SEQUENCE|ZOO_EPHEMERAL, 
+				IZkApplyClient::ZkApplyClientImpl::ReserveNodeCreateCB, (void*)context->context_id_ );
+
+			if ( ret != ZOK )
+			{
+				Context::Destory(context);
+			}
+			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"cli%d create reserve node path=%s ret=%d \n",client_id_, path.c_str(), ret );
+		}
+	}
+
 	void IZkApplyClient::ZkApplyClientImpl::ApplyNodeCB(int rc, const char *value, const void *data)
 	{	
-		ZkAutoLock lock(&IObjectContainer::mutex_);
-		unsigned index = (unsigned int)(data);
-		Context context;
-		if ( !Context::GetContext( index, context) )
+		uintptr_t index = (uintptr_t)data;
+		ContextRef context( index );
+		if ( !context.IsValid() )
 		{
 			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"ApplyNodeCB Callback is null\n");
 			return;
@@ -1849,64 +5690,66 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 			ZkClientPrint( ZK_LOG_LVL_DETAIL,"create apply node callback rc=%d path=null\n", rc );
 		}
 		
-		context.apply_client_->UpdateApplyNode( rc, value );	
+		context->apply_client_->UpdateApplyNode( index, rc, value );	
 		Context::Destory( index );
 	}
 
 	void IZkApplyClient::ZkApplyClientImpl::ApplyListNotifyCB(int rc,const struct String_vector *strings, const void *data)
 	{	
-		ZkAutoLock lock(&IObjectContainer::mutex_);
-		unsigned index = (unsigned int)(data);
-		Context context;
-		if ( !Context::GetContext( index, context ) )
+		uintptr_t index = (uintptr_t)data;
+		ContextRef context( index );
+		if ( !context.IsValid() )
 		{
 			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"ApplyListNotifyCB Callback is null\n");
 			return;
 		}
 	
 		ZkClientPrint( ZK_LOG_LVL_DETAIL,"get apply list callback rc=%d\n", rc );
-		context.apply_client_->UpdateApplyList( rc, strings );		
+		context->apply_client_->UpdateApplyList( rc, strings );		
 		Context::Destory( index );
 	}
 
-	void IZkApplyClient::ZkApplyClientImpl::ApplyListChangeWatch(zhandle_t *zh, int type, int state, const char *path,void *watcherCtx)
-	{	
-		ZkAutoLock lock(&IObjectContainer::mutex_);
-		unsigned index = (unsigned int)watcherCtx;
-		Context context;
-		if ( !Context::GetContext( index, context ) )
+	void IZkApplyClient::ZkApplyClientImpl::PreNodeExistsCB(int rc, const struct Stat *stat, const void *data)
+	{
+		uintptr_t index = (uintptr_t)data;
+		ContextRef context( index );
+		if ( !context.IsValid() )
 		{
-			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"ApplyListChangeWatch context is null \n" );
+			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"PreNodeExistsCB Callback is null\n");
 			return;
 		}
-		Context* new_context = Context::Create( &context );
-		int ret = zoo_awget_children( zh, path, IZkApplyClient::ZkApplyClientImpl::ApplyListChangeWatch,watcherCtx, IZkApplyClient::ZkApplyClientImpl::ApplyListNotifyCB, (void*)new_context->context_id_ );	
-		
-		if ( ret != ZOK )
-		{
-			Context::Destory( new_context );
-		}
-		if ( path != NULL )
+
+		ZkClientPrint( ZK_LOG_LVL_DETAIL,"exists pre apply node callback rc=%d path=%s\n", rc, context->path_.c_str() );
+		context->apply_client_->UpdatePreNode( rc, context->path_.c_str() );
+		Context::Destory( index );
+	}
+
+	void IZkApplyClient::ZkApplyClientImpl::PreNodeChangeWatch(zhandle_t *zh, int type, int state, const char *path,void *watcherCtx)
+	{	
+		uintptr_t index = (uintptr_t)watcherCtx;
+		ContextRef context( index );
+		if ( !context.IsValid() )
 		{
-			ZkClientPrint( ZK_LOG_LVL_DETAIL,"ApplyListChangeWatch type=%d path=%s ret=%d\n", type, path, ret );
+			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"PreNodeChangeWatch context is null \n" );
+			return;
 		}
-		else
+		if ( type == ZOO_SESSION_EVENT || path == NULL )
 		{
-			ZkClientPrint( ZK_LOG_LVL_DETAIL,"ApplyListChangeWatch type=%d path=null ret=%d\n", type, ret );
+			return;
 		}
-		
+		ZkClientPrint( ZK_LOG_LVL_DETAIL,"PreNodeChangeWatch type=%d path=%s\n", type, path );
+		context->apply_client_->UpdatePreNodeEvent( type, path );
 	}
 
 	int IZkApplyClient::ZkApplyClientImpl::GetSourceList()
 	{
-		if ( source_list_wath_context_ == NULL )
+		if ( source_list_wath_context_ == 0 )
 		{
-			source_list_wath_context_ = Context::Create( zkhandle_, this );
-			source_list_wath_context_->node_type_ = SourceNode;
+			source_list_wath_context_ = Context::Create( zkhandle_, this, 0, "", SourceNode )->context_id_;
 		}
-		Context* context_source = Context::Create( zkhandle_, this, 0, source_path_, SourceNode );
+		Context* context_source = Context::Create( zkhandle_, this, 0, source_path_.c_str(), SourceNode );
 
-		int ret = zoo_awget_children( zkhandle_, source_path_.c_str(), IZkApplyClient::ZkApplyClientImpl::ListChangeWatch, (void*)source_list_wath_context_->context_id_, 
+		int ret = zoo_awget_children( zkhandle_, source_path_.c_str(), IZkApplyClient::ZkApplyClientImpl::ListChangeWatch, (void*)source_list_wath_context_, 
 			IZkApplyClient::ZkApplyClientImpl::ListNotifyCB, (void*)context_source->context_id_ );
 		if ( ret != ZOK )
 		{
@@ -1922,13 +5765,9 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 	{
 		if ( path != NULL )
 		{
-			Context* context_watch = Context::Create( zkhandle_,this, 0, path, SourceNode );
-		/*	if ( source_node_wath_context_ == NULL )
-			{
-				source_node_wath_context_ = Context::Create( zkhandle_,this, 0, path, SourceNode );
-			}*/
+			uintptr_t watch_id = GetNodeWatch( path, SourceNode );
 			Context* context = Context::Create( zkhandle_,this, 0, path, SourceNode );
-			int ret = zoo_awget( zkhandle_, path, IZkApplyClient::ZkApplyClientImpl::NodeChangeWatch, (void*)context_watch->context_id_,
+			int ret = zoo_awget( zkhandle_, path, IZkApplyClient::ZkApplyClientImpl::NodeChangeWatch, (void*)watch_id,
 				IZkApplyClient::ZkApplyClientImpl::NodeNotifyCB, (void*)context->context_id_ );
 			if ( ret != ZOK )
 			{
@@ -1943,61 +5782,77 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 	int IZkApplyClient::ZkApplyClientImpl::UpdateSourceList( int rc, const struct String_vector* strings )
 	{
 		ZkAutoLock lock( &mutex_ );
+		if ( zkhandle_ == NULL )
+		{
+			// ѾϿỰжϿ֮ǰ
+			return rc;
+		}
 		if ( rc == ZOK )
 		{
 			if ( strings != NULL )
 			{		
 				
-				Sources::iterator itr = sources_.begin();
-				while ( itr != sources_.end() )
 				{
-					bool is_find = false;
-					for ( int i = 0; i < strings->count; i++ )
+					ZkAutoWriteLock cache_lock( &cache_lock_ );
+					Sources::iterator itr = sources_.begin();
+					while ( itr != sources_.end() )
 					{
-						string path = source_path_;
-						path += "/";
-						path += strings->data[i];
+						bool is_find = false;
+						for ( int i = 0; i < strings->count; i++ )
+						{
+							string path = source_path_;
+							path += "/";
+							path += strings->data[i];
 
-						if ( itr->first == path )
+							if ( itr->first == path )
+							{
+								is_find = true;
+								break;
+							}
+						}
+						if ( is_find )
 						{
-							is_find = true;
-							break;
+							itr++;
+						}
+						else
+						{
+							RemoveNodeWatch( itr->first.c_str() );
+							value_pool_.Destory( itr->second );
+							sources_.erase( itr++ );
+							MarkSnapshot();
 						}
 					}
-					if ( is_find )
-					{
-						itr++;
-					}
-					else
-					{
-						NodeValue::Destory( itr->second );
-						sources_.erase( itr++ );
-					}
-				}
 
 
-				for ( int i = 0; i < strings->count; i++ )
-				{
-					string path = source_path_;
-					path += "/";
-					path += strings->data[i];
+					for ( int i = 0; i < strings->count; i++ )
+					{
+						string path = source_path_;
+						path += "/";
+						path += strings->data[i];
 
-					Sources::iterator itr = sources_.find( path );
+						Sources::iterator itr = sources_.find( path );
 
-					if ( itr == sources_.end() )
-					{
-						sources_[path] = NULL;
-						int ret = GetSourceNode( path.c_str() );
-						if ( ret != ZOK )
+						if ( itr == sources_.end() )
 						{
-							itr = sources_.find( path );
-							if ( itr != sources_.end() )
+							sources_[path] = NULL;
+							int ret = GetSourceNode( path.c_str() );
+							if ( ret == ZOK )
 							{
-								sources_.erase( itr );
+								snapshot_loading_.insert( path );
 							}
-						}		
+							else
+							{
+								RemoveNodeWatch( path.c_str() );
+								itr = sources_.find( path );
+								if ( itr != sources_.end() )
+								{
+									sources_.erase( itr );
+								}
+							}		
+						}
 					}
 				}
+				PublishSnapshot();
 
 				// ֪ͨб£бгʼɹ
 				NotifySourceList();
@@ -2034,7 +5889,7 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 		param.source_change_param.values = source_buffer;
 		param.source_change_param.len = source_size;	
 		param.context = callback_context_;
-		callback_( &param );	
+		Notify( param );	
 	
 		DEL_PTR_ARRAY( source_buffer );
 	}
@@ -2042,52 +5897,81 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 	int IZkApplyClient::ZkApplyClientImpl::UpdateSourceNode( int rc, const char *value, int value_len, const char* path )
 	{
 		ZkAutoLock lock( &mutex_ );
+		if ( zkhandle_ == NULL )
+		{
+			// ѾϿỰжϿ֮ǰ
+			return rc;
+		}
+		snapshot_loading_.erase( path );
 		if ( rc == ZOK )
 		{
 			Sources::iterator itr = sources_.find( path );
-			NodeValue* node_value = NULL;
-			if ( itr != sources_.end() )
-			{			
-				if ( itr->second == NULL )
-				{
-					itr->second = NodeValue::Create();
-				}
-				node_value = itr->second;
+			// ӦϽֻڴ뻺ʱһԭʼ
+			bool is_valid = node_view_->Attach( value, value_len );
+			if ( is_valid && itr != sources_.end() && itr->second != NULL 
+				&& itr->second->GetFingerprint() == node_view_->GetFingerprint() )
+			{
+				// ûб仯縺ظϱҪ»֪ͨ
+				ZkClientPrint( ZK_LOG_LVL_DETAIL,"cli%d source node not changed path=%s\n", client_id_, path );
+				return rc;
 			}
-			else
 			{
-				node_value = NodeValue::Create();
+				ZkAutoWriteLock cache_lock( &cache_lock_ );
+				NodeValue* node_value = NULL;
+				if ( itr != sources_.end() )
+				{			
+					if ( itr->second == NULL )
+					{
+						itr->second = value_pool_.Create();
+					}
+					node_value = itr->second;
+				}
+				else
+				{
+					node_value = value_pool_.Create();
+				}
+				if ( is_valid )
+				{
+					node_value->Assign( node_view_ );
+				}
+				sources_[path] = node_value;
 			}
-			node_value->DeSerialize( value, value_len );
-			sources_[path] = node_value;
+			MarkSnapshot( path );
+			PublishSnapshot();
 
 			NotifySourceList();
 		}
 		else
 		{
-			Sources::iterator itr = sources_.find( path );
-			if ( itr != sources_.end() )
 			{
-				if ( itr->second != NULL )
+				ZkAutoWriteLock cache_lock( &cache_lock_ );
+				RemoveNodeWatch( path );
+				Sources::iterator itr = sources_.find( path );
+				if ( itr != sources_.end() )
 				{
-					NodeValue::Destory( itr->second );
+					if ( itr->second != NULL )
+					{
+						value_pool_.Destory( itr->second );
+					}
+					sources_.erase( itr );
+					MarkSnapshot();
 				}
-				sources_.erase( itr );
 			}
+			PublishSnapshot();
 		}
 		return rc;
 	}
 
 	int IZkApplyClient::ZkApplyClientImpl::GetReserveList()
 	{
-		if ( reserve_list_watch_context_ == NULL )
+		if ( reserve_list_watch_context_ == 0 )
 		{
-			reserve_list_watch_context_= Context::Create( zkhandle_, this, 0, reserve_queue_path_, ReserveNode ); 
+			reserve_list_watch_context_= Context::Create( zkhandle_, this, 0, reserve_queue_path_.c_str(), ReserveNode )->context_id_; 
 		}
-		Context* context_source = Context::Create( zkhandle_, this, 0, reserve_queue_path_, ReserveNode ); 
+		Context* context_source = Context::Create( zkhandle_, this, 0, reserve_queue_path_.c_str(), ReserveNode ); 
 		
 		int ret = zoo_awget_children( zkhandle_, reserve_queue_path_.c_str(), IZkApplyClient::ZkApplyClientImpl::ListChangeWatch, 
-			(void*)reserve_list_watch_context_->context_id_ , IZkApplyClient::ZkApplyClientImpl::ListNotifyCB, (void*)context_source->context_id_ );
+			(void*)reserve_list_watch_context_ , IZkApplyClient::ZkApplyClientImpl::ListNotifyCB, (void*)context_source->context_id_ );
 		if ( ret != ZOK )
 		{
 			Context::Destory( context_source );
@@ -2100,66 +5984,79 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 	{
 		if ( path != NULL )
 		{
-			/*if ( reserve_node_watch_context_ == NULL )
-			{
-				reserve_node_watch_context_ = Context::Create( zkhandle_, this, 0, path, ReserveNode );
-			}*/
-			Context* context_watch = Context::Create( zkhandle_, this, 0, path, ReserveNode );
+			uintptr_t watch_id = GetNodeWatch( path, ReserveNode );
 			Context* context = Context::Create( zkhandle_, this, 0, path, ReserveNode );
 		
-			int ret = zoo_awget( zkhandle_, path, IZkApplyClient::ZkApplyClientImpl::NodeChangeWatch, (void*)context_watch->context_id_, 
+			int ret = zoo_awget( zkhandle_, path, IZkApplyClient::ZkApplyClientImpl::NodeChangeWatch, (void*)watch_id, 
 				IZkApplyClient::ZkApplyClientImpl::NodeNotifyCB, (void*)context->context_id_ );
 			if ( ret != ZOK )
 			{
 				Context::Destory( context );
 			}
 			ZkClientPrint( ZK_LOG_LVL_DETAIL,"cli%d get reserve node path=%s result=%d applystate=%d\n",client_id_, path , ret, apply_state_ );
+			return ret;
 		}
 		return ZOK;
 	}
 	int IZkApplyClient::ZkApplyClientImpl::UpdateReserveList( int rc, const struct String_vector* strings )
 	{
 		ZkAutoLock lock( &mutex_ );
+		if ( zkhandle_ == NULL )
+		{
+			// ѾϿỰжϿ֮ǰ
+			return rc;
+		}
 		if ( rc == ZOK )
 		{
 			if ( strings != NULL )
 			{		
-				ReserveQueue::iterator itr = reserve_queue_.begin();
-				while ( itr != reserve_queue_.end() )
 				{
-					bool is_find = false;
+					ZkAutoWriteLock cache_lock( &cache_lock_ );
+					ReserveQueue::iterator itr = reserve_queue_.begin();
+					while ( itr != reserve_queue_.end() )
+					{
+						bool is_find = false;
+						for ( int i = 0; i < strings->count; i++ )
+						{
+							string path = reserve_queue_path_;
+							path += "/";
+							path += strings->data[i];
+							if ( itr->first == path )
+							{
+								is_find = true;
+								break;
+							}
+						}
+						if ( is_find )
+						{
+							itr++;
+						}
+						else
+						{
+							RemoveNodeWatch( itr->first.c_str() );
+							own_reserves_.erase( itr->first );
+							value_pool_.Destory( itr->second );
+							reserve_queue_.erase( itr++ );
+							MarkSnapshot();
+						}
+					}
 					for ( int i = 0; i < strings->count; i++ )
 					{
 						string path = reserve_queue_path_;
 						path += "/";
 						path += strings->data[i];
-						if ( itr->first == path )
+						if ( GetReserveNode( path.c_str() ) == ZOK && reserve_queue_.find( path ) == reserve_queue_.end() )
 						{
-							is_find = true;
-							break;
+							snapshot_loading_.insert( path );
 						}
 					}
-					if ( is_find )
-					{
-						itr++;
-					}
-					else
-					{
-						NodeValue::Destory( itr->second );
-						reserve_queue_.erase( itr++ );
-					}
-				}
-				for ( int i = 0; i < strings->count; i++ )
-				{
-					string path = reserve_queue_path_;
-					path += "/";
-					path += strings->data[i];
-					GetReserveNode( path.c_str() );
 				}
+				PublishSnapshot();
 			}
 			else
 			{
 				RemoveReserveNode(NULL);
+				PublishSnapshot();
 			}
 			if ( is_inited_ == false && callback_ != NULL )
 			{
@@ -2167,7 +6064,7 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 				CallbackParam param;
 				param.type = ApplyInited;
 				param.context = callback_context_;
-				callback_( &param );
+				Notify( param );
 			}		
 		}
 		else
@@ -2181,45 +6078,115 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 	int IZkApplyClient::ZkApplyClientImpl::UpdateReserveNode( int rc, const char *value, int value_len, const char* path )
 	{
 		ZkAutoLock lock( &mutex_ );
+		if ( zkhandle_ == NULL )
+		{
+			// ѾϿỰжϿ֮ǰ
+			return rc;
+		}
+		snapshot_loading_.erase( path );
 		if ( rc == ZOK )
 		{
-			ReserveQueue::iterator itr = reserve_queue_.find( path );
-			NodeValue* node_value = NULL;
-			if ( itr != reserve_queue_.end() )
 			{
-				node_value = itr->second;
+				ZkAutoWriteLock cache_lock( &cache_lock_ );
+				ReserveQueue::iterator itr = reserve_queue_.find( path );
+				NodeValue* node_value = NULL;
+				bool is_changed = false;
+				if ( itr != reserve_queue_.end() )
+				{
+					node_value = itr->second;
+				}
+				else
+				{
+					node_value = value_pool_.Create();
+					is_changed = true;
+				}
+
+				if ( node_view_->Attach( value, value_len ) && node_value->GetFingerprint() != node_view_->GetFingerprint() )
+				{
+					node_value->Assign( node_view_ );
+					is_changed = true;
+				}
+				reserve_queue_[path] = node_value;
+				if ( is_changed )
+				{
+					MarkSnapshot( path );
+				}
 			}
-			else
+			PublishSnapshot();
+		}
+		else
+		{
+			if ( rc == ZNONODE )
 			{
-				node_value = NodeValue::Create();
+				// ڵɾб仯֪ͨϿʱҲҪɾ
+				ZkAutoWriteLock cache_lock( &cache_lock_ );
+				RemoveNodeWatch( path );
+				own_reserves_.erase( path );
 			}
-
-			node_value->DeSerialize( value, value_len );
-			reserve_queue_[path] = node_value;
+			// һеĽڵ
+			PublishSnapshot();
 		}
 		return rc;
 	}
 
+	uintptr_t IZkApplyClient::ZkApplyClientImpl::GetNodeWatch( const char* path, NodeType type )
+	{
+		NodeWatches::iterator itr = node_watches_.find( path );
+		if ( itr != node_watches_.end() )
+		{
+			return itr->second;
+		}
+		Context* context = Context::Create( zkhandle_, this, 0, path, type );
+		if ( context->context_id_ == 0 )
+		{
+			// עwatchʱȡģٴ
+			Context::Destory( context );
+			return 0;
+		}
+		node_watches_[path] = context->context_id_;
+		return context->context_id_;
+	}
+
+	void IZkApplyClient::ZkApplyClientImpl::RemoveNodeWatch( const char* path )
+	{
+		NodeWatches::iterator itr = node_watches_.find( path );
+		if ( itr != node_watches_.end() )
+		{
+			// zkõwatchʱȡģֱӺ
+			Context::Destory( itr->second );
+			node_watches_.erase( itr );
+		}
+	}
+
+	void IZkApplyClient::ZkApplyClientImpl::RemoveNodeWatches( const string& prefix )
+	{
+		NodeWatches::iterator itr = node_watches_.lower_bound( prefix );
+		while ( itr != node_watches_.end() && itr->first.compare( 0, prefix.size(), prefix ) == 0 )
+		{
+			Context::Destory( itr->second );
+			node_watches_.erase( itr++ );
+		}
+	}
+
 	void IZkApplyClient::ZkApplyClientImpl::ListNotifyCB(int rc,const struct String_vector *strings, const void *data)
 	{
-		ZkAutoLock lock(&IObjectContainer::mutex_);
-		unsigned index = (unsigned int)data;
-		Context context;
-		if ( !Context::GetContext( index, context ) )
+		uintptr_t index = (uintptr_t)data;
+		ContextRef context( index );
+		if ( !context.IsValid() )
 		{
 			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"ListNotifyCB Callback is null\n");
 			return;
 		}
 
-		if ( context.node_type_ == SourceNode )
+		if ( context->node_type_ == SourceNode )
 		{
 			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"get source list callback rc=%d\n", rc );
-				context.apply_client_->UpdateSourceList( rc, strings );
+				context->apply_client_->UpdateSourceList( rc, strings );
 		}
-		else if ( context.node_type_ == ReserveNode )
+		else if ( context->node_type_ == ReserveNode )
 		{
 			ZkClientPrint( ZK_LOG_LVL_DETAIL,"get reserve list callback rc=%d\n", rc  );
-				context.apply_client_->UpdateReserveList( rc, strings );
+				context->apply_client_->UpdateReserveList( rc, strings );
 		}
 		
 		Context::Destory( index );
@@ -2227,24 +6194,23 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 
 	void IZkApplyClient::ZkApplyClientImpl::NodeNotifyCB(int rc, const char *value, int value_len, const struct Stat *stat, const void *data)
 	{
-		ZkAutoLock lock(&IObjectContainer::mutex_);
-		unsigned index = (unsigned int)data;
-		Context context;
-		if ( !Context::GetContext( index, context ) )
+		uintptr_t index = (uintptr_t)data;
+		ContextRef context( index );
+		if ( !context.IsValid() )
 		{
 			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"NodeNotifyCB Callback is null\n");
 			return;
 		}
 		
-		if ( context.node_type_ == SourceNode )
+		if ( context->node_type_ == SourceNode )
 		{
-			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"get source node callback rc=%d path=%d \n", rc ,context.path_.c_str() );
-				context.apply_client_->UpdateSourceNode( rc, value, value_len, context.path_.c_str() );
+			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"get source node callback rc=%d path=%d \n", rc ,context->path_.c_str() );
+				context->apply_client_->UpdateSourceNode( rc, value, value_len, context->path_.c_str() );
 		}
-		else if ( context.node_type_ == ReserveNode )
+		else if ( context->node_type_ == ReserveNode )
 		{
-			ZkClientPrint( ZK_LOG_LVL_DETAIL,"get reserve node callback rc=%d path=%d \n", rc ,context.path_.c_str() );
-				context.apply_client_->UpdateReserveNode( rc, value, value_len, context.path_.c_str() );
+			ZkClientPrint( ZK_LOG_LVL_DETAIL,"get reserve node callback rc=%d path=%d \n", rc ,context->path_.c_str() );
+				context->apply_client_->UpdateReserveNode( rc, value, value_len, context->path_.c_str() );
 		}
 
 		Context::Destory( index );
@@ -2252,15 +6218,14 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 
 	void IZkApplyClient::ZkApplyClientImpl::ListChangeWatch(zhandle_t *zh, int type, int state, const char *path,void *watcherCtx)
 	{
-		ZkAutoLock lock(&IObjectContainer::mutex_);
-		unsigned index = (unsigned int)watcherCtx;
-		Context context;
-		if ( !Context::GetContext( index, context ) )
+		uintptr_t index = (uintptr_t)watcherCtx;
+		ContextRef context( index );
+		if ( !context.IsValid() )
 		{
 			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"ListChangeWatch context fail \n" );
 			return;
 		}
-		Context* context_cb = Context::Create( &context );
+		Context* context_cb = Context::Create( context.Get() );
 		int ret = zoo_awget_children( zh, path, IZkApplyClient::ZkApplyClientImpl::ListChangeWatch,watcherCtx, 
 			IZkApplyClient::ZkApplyClientImpl::ListNotifyCB,(void*)context_cb->context_id_ );
 		if ( ret != ZOK )
@@ -2273,14 +6238,13 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 
 	void IZkApplyClient::ZkApplyClientImpl::NodeChangeWatch(zhandle_t *zh, int type, int state, const char *path,void *watcherCtx)
 	{
-		ZkAutoLock lock(&IObjectContainer::mutex_);
-		unsigned index = (unsigned int)watcherCtx;
-		Context context;
-		if ( !Context::GetContext( index, context ) )
+		uintptr_t index = (uintptr_t)watcherCtx;
+		ContextRef context( index );
+		if ( !context.IsValid() )
 		{
 			return;
 		}
-		Context* context_cb = Context::Create( &context );
+		Context* context_cb = Context::Create( context.Get() );
 		int ret = zoo_awget( zh, path, IZkApplyClient::ZkApplyClientImpl::NodeChangeWatch, watcherCtx, 
 			IZkApplyClient::ZkApplyClientImpl::NodeNotifyCB, (void*)context_cb->context_id_ );
 		if ( ret != ZOK )
@@ -2292,26 +6256,78 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 
 	int IZkApplyClient::ZkApplyClientImpl::Disconnect()
 	{
-		ZkAutoLock lock( &mutex_ );
-		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"Disconnect call\n");
-		system_state_ = zkDisconnect;
-		apply_state_ = idle;
-		is_inited_ = false;
-		RemoveSourceNode( NULL );
-		RemoveReserveNode( NULL );
-		if ( zkhandle_ )
+		zhandle_t* zkhandle = NULL;
+		bool is_shared_session = false;
 		{
-			int ret = zookeeper_close( zkhandle_ );
+			ZkAutoLock lock( &mutex_ );
+			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"Disconnect call\n");
+			if ( zkhandle_ != NULL && is_shared_session_ )
+			{
+				// ỰԱclientʹãɾclientʱڵ㣬ֹͣбwatchõwatchʱȡģ
+				if ( apply_state_ == applying && !apply_path_.empty() )
+				{
+					zoo_adelete( zkhandle_, apply_path_.c_str(), -1, IZkApplyClient::ZkApplyClientImpl::VoidCB, NULL );
+				}
+				for ( set<string>::iterator itr = own_reserves_.begin(); itr != own_reserves_.end(); itr++ )
+				{
+					zoo_adelete( zkhandle_, itr->c_str(), -1, IZkApplyClient::ZkApplyClientImpl::VoidCB, NULL );
+				}
+				Context::Destory( reserve_list_watch_context_ );
+				Context::Destory( apply_node_watch_context_ );
+				Context::Destory( source_list_wath_context_ );
+				reserve_list_watch_context_ = 0;
+				apply_node_watch_context_ = 0;
+				source_list_wath_context_ = 0;
+			}
+			own_reserves_.clear();
+			CancelAutoDeletes();
+			CancelApplyTimer();
+			apply_context_ = 0;
+			apply_pre_path_ = "";
+			system_state_ = zkDisconnect;
+			apply_state_ = idle;
+			is_inited_ = false;
+			RemoveSourceNode( NULL );
+			RemoveReserveNode( NULL );
+			PublishSnapshot();
+			if ( zkhandle_ == NULL )
+			{
+				return -1;
+			}
+			zkhandle = zkhandle_;
 			zkhandle_ = NULL;
-			return ret;
+			is_shared_session = is_shared_session_;
+#ifndef THREADED
+			// ̵߳ľҪProcess⣬ڹر
+			return CloseHandle( zkhandle, is_shared_session );
+#endif
 		}
-		return -1;
+		// ̰߳汾zookeeper_closeȴص̣߳صڵȴ2ر
+		return CloseHandle( zkhandle, is_shared_session );
+	}
+
+	int IZkApplyClient::ZkApplyClientImpl::CloseHandle( zhandle_t* zkhandle, bool is_shared_session )
+	{
+		if ( is_shared_session )
+		{
+			return ZkSessionPool::Detach( zkhandle, (void*)session_context_ );
+		}
+		return event_loop_.Close( zkhandle );
 	}
 
 	void IZkApplyClient::ZkApplyClientImpl::EndApply()
 	{
-		// ɾ
-		int ret = zoo_adelete( zkhandle_, apply_path_.c_str(), -1, IZkApplyClient::ZkApplyClientImpl::VoidCB, (void*)this );
+		CancelApplyTimer();
+		apply_context_ = 0;
+		apply_pre_path_ = "";
+		apply_pos_ = -1;
+
+		// ɾУڵ㻹δʱUpdateApplyNodeɾٵĽڵ㣩
+		int ret = ZOK;
+		if ( !apply_path_.empty() )
+		{
+			ret = zoo_adelete( zkhandle_, apply_path_.c_str(), -1, IZkApplyClient::ZkApplyClientImpl::VoidCB, (void*)this );
+		}
 
 		apply_state_ = idle;
 
@@ -2320,19 +6336,31 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 		apply_path_ = "";		
 	}
 
+	void IZkApplyClient::ZkApplyClientImpl::FailApply( int rc )
+	{
+		EndApply();
+		if ( callback_ != NULL )
+		{
+			CallbackParam param;
+			param.type = ApplyFailCb;
+			param.result = rc;
+			param.context = callback_context_;
+			Notify( param );
+		}
+	}
+
 
 	void IZkApplyClient::ZkApplyClientImpl::Watch(zhandle_t *zh, int type, int state, const char *path,void *watcherCtx)
 	{
-		ZkAutoLock lock(&IObjectContainer::mutex_);
 		ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"ApplyClient Watch type=%d state=%d \n", type, state );
 
 		
 		if ( type == ZOO_SESSION_EVENT )
 		{
 			
-			unsigned index = (unsigned int)watcherCtx;
-			Context context;
-			if ( !Context::GetContext( index, context ) )
+			uintptr_t index = (uintptr_t)watcherCtx;
+			ContextRef context( index );
+			if ( !context.IsValid() )
 			{
 				ZkClientPrint( ZK_LOG_LVL_KEYSTATUS, "ApplyClient Watch context is null\n" );
 				return;
@@ -2340,15 +6368,15 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 
 			if ( state == ZOO_CONNECTED_STATE )
 			{
-				context.apply_client_->OnConnected();
+				context->apply_client_->OnConnected();
 			}
 			else if ( state == ZOO_EXPIRED_SESSION_STATE )
 			{
-				context.apply_client_->OnDisconnected();
+				context->apply_client_->OnDisconnected();
 			}
 			else if ( state == ZOO_CONNECTING_STATE )
 			{
-				context.apply_client_->OnConnecting();
+				context->apply_client_->OnConnecting();
 			}
 		}
 	}
@@ -2361,6 +6389,12 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 		system_state_ = zkConnected;
 		LoadSource();
 
+		// ڼбǰһڵĻظʧʱ»ȡбŶ
+		if ( apply_state_ == applying && apply_path_ != "" && apply_pre_path_ == "" && !GetApplyList() )
+		{
+			FailApply( ZSYSTEMERROR );
+		}
+
 		if ( callback_ != NULL )
 		{
 			CallbackParam param;
@@ -2374,7 +6408,7 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 			}
 			param.result = 0;
 			param.context = callback_context_;
-			callback_( &param );
+			Notify( param );
 		}
 	}
 
@@ -2389,7 +6423,7 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 			param.type = DisconnectCb;
 			param.result = 0;
 			param.context = callback_context_;
-			callback_( &param );
+			Notify( param );
 		}
 	}
 
@@ -2402,48 +6436,58 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 
 	void IZkApplyClient::ZkApplyClientImpl::RemoveReserveNode( const char* path )
 	{
+		ZkAutoWriteLock cache_lock( &cache_lock_ );
 		if ( path == NULL )
 		{
+			RemoveNodeWatches( reserve_queue_path_ + "/" );
 			ReserveQueue::iterator itr = reserve_queue_.begin();
 			while ( itr != reserve_queue_.end() )
 			{
-				NodeValue::Destory( itr->second );
+				value_pool_.Destory( itr->second );
 				itr++;
 			}
 			reserve_queue_.clear();
+			RemoveLoading( reserve_queue_path_ + "/" );
 		}
 		else
 		{
+			RemoveNodeWatch( path );
 			ReserveQueue::iterator itr = reserve_queue_.find( path );
 			if ( itr != reserve_queue_.end() )
 			{
-				NodeValue::Destory( itr->second );
+				value_pool_.Destory( itr->second );
 				reserve_queue_.erase( itr );
 			}
 		}
+		MarkSnapshot();
 	}
 
 	void IZkApplyClient::ZkApplyClientImpl::RemoveSourceNode( const char* path )
 	{
+		ZkAutoWriteLock cache_lock( &cache_lock_ );
 		if ( path == NULL )
 		{
+			RemoveNodeWatches( source_path_ + "/" );
 			Sources::iterator itr = sources_.begin();
 			while ( itr != sources_.end() )
 			{
-				NodeValue::Destory( itr->second );
+				value_pool_.Destory( itr->second );
 				itr++;
 			}
 			sources_.clear();
+			RemoveLoading( source_path_ + "/" );
 		}
 		else
 		{
+			RemoveNodeWatch( path );
 			Sources::iterator itr = sources_.find( path );
 			if ( itr != sources_.end() )
 			{
-				NodeValue::Destory( itr->second );
+				value_pool_.Destory( itr->second );
 				sources_.erase( itr );
 			}
 		}
+		MarkSnapshot();
 	}
 
 	bool IZkApplyClient::ZkApplyClientImpl::Init( bool bInit /* = true */ )
@@ -2452,6 +6496,7 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 		if ( bInit == false )
 		{
 			bRet = pthread_mutex_destroy( &mutex_ );
+			pthread_mutex_destroy( &snapshot_mutex_ );
 		}
 		else
 		{
@@ -2459,109 +6504,92 @@ void ZkClientPrint( unsigned short lvl, const char* content,...)
 			pthread_mutexattr_init( &attr );	
 			pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
 			bRet = pthread_mutex_init( &mutex_, &attr );		
+			pthread_mutex_init( &snapshot_mutex_, NULL );
 		}
 		return bRet;
 	}
 
-	struct ThreadParam
+	void IZkApplyClient::ZkApplyClientImpl::OnReserveCreated( const char* path, unsigned auto_delete_time )
 	{
-		zhandle_t* zkhandle_;
-		string path_;
-		unsigned auto_delete_time_;
-	};
-
-#ifdef WIN32
-	unsigned  __stdcall AutoDeleteReserveNode(void *arg)
-	{
-		ThreadParam* param = (ThreadParam*)arg;
-		if ( param != NULL )
+		ZkAutoLock lock( &mutex_ );
+		if ( zkhandle_ == NULL )
 		{
-			string path = param->path_;
-			zhandle_t* handle = param->zkhandle_;
-#ifdef WIN32
-			Sleep( param->auto_delete_time_ * 1000 );
-#else
-			sleep( param->auto_delete_time_ );
-#endif
-			// ɾhandleѾ٣ɾʧ
-			try
+			return;
+		}
+		if ( is_shared_session_ )
+		{
+			own_reserves_.insert( path );
+		}
+		if ( auto_delete_time != 0 )
+		{
+			Context* context = Context::Create( zkhandle_, this, 0, path, ReserveNode );
+			uintptr_t timer_id = 0;
+			if ( context->context_id_ != 0 )
 			{
-				zoo_adelete( handle, path.c_str(), -1, IZkApplyClient::ZkApplyClientImpl::VoidCB, NULL );	
+				timer_id = ZkTimerWheel::Add( auto_delete_time * 1000, IZkApplyClient::ZkApplyClientImpl::AutoDeleteTimer, context->context_id_ );
 			}
-			catch (...)
+			if ( timer_id == 0 )
 			{
-				ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"handle is null\n");
+				Context::Destory( context );
+				ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"cli%d add auto delete timer fail path=%s\n", client_id_, path );
+				return;
 			}
-			// ٶzkhandleü
-			
+			auto_deletes_[context->context_id_] = timer_id;
+			ZkClientPrint( ZK_LOG_LVL_DETAIL,"auto delete reserve node time=%d path=%s\n", auto_delete_time, path );
 		}
-		DEL_PTR(param);
-
-		return 0;
 	}
-#endif
 
-	void* AutoDeleteReserveNodeForLinux(void* buff)
+	void IZkApplyClient::ZkApplyClientImpl::AutoDeleteTimer( uintptr_t index )
 	{
-		ThreadParam* param = (ThreadParam*)buff;
-		if ( param != NULL )
+		ContextRef context( index );
+		if ( context.IsValid() )
 		{
-			string path = param->path_;
-			zhandle_t* handle = param->zkhandle_;
-#ifdef WIN32
-			Sleep( param->auto_delete_time_ * 1000 );
-#else
-			sleep( param->auto_delete_time_ );
-#endif
+			context->apply_client_->OnAutoDelete( index, context->path_.c_str() );
+		}
+	}
 
-			// ɾhandleѾ٣ɾʧ
-			try
-			{
-				zoo_adelete( handle, path.c_str(), -1, IZkApplyClient::ZkApplyClientImpl::VoidCB, NULL );	
-			}
-			catch (...)
-			{
-				ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"AutoDeleteReserveNode Handle is NULL\n");
-			}		
+	void IZkApplyClient::ZkApplyClientImpl::OnAutoDelete( uintptr_t index, const char* path )
+	{
+		ZkAutoLock lock( &mutex_ );
+		AutoDeletes::iterator itr = auto_deletes_.find( index );
+		if ( itr == auto_deletes_.end() )
+		{
+			// ѾϿʱỰȡ
+			return;
 		}
-		DEL_PTR(param);
-		return 0;
+		auto_deletes_.erase( itr );
+		own_reserves_.erase( path );
+		if ( zkhandle_ != NULL )
+		{
+			int ret = zoo_adelete( zkhandle_, path, -1, IZkApplyClient::ZkApplyClientImpl::VoidCB, NULL );
+			ZkClientPrint( ZK_LOG_LVL_DETAIL,"cli%d auto delete reserve node path=%s ret=%d\n", client_id_, path, ret );
+		}
+		Context::Destory( index );
 	}
 
+	void IZkApplyClient::ZkApplyClientImpl::CancelAutoDeletes()
+	{
+		for ( AutoDeletes::iterator itr = auto_deletes_.begin(); itr != auto_deletes_.end(); itr++ )
+		{
+			ZkTimerWheel::Cancel( itr->second );
+			Context::Destory( itr->first );
+		}
+		auto_deletes_.clear();
+	}
 
 	void IZkApplyClient::ZkApplyClientImpl::ReserveNodeCreateCB(int rc, const char *value, const void *data)
 	{
-		ZkAutoLock lock( &IObjectContainer::mutex_ );	
-		unsigned index = (unsigned int)data;
-		Context context;
-		if ( !Context::GetContext( index, context) )
+		uintptr_t index = (uintptr_t)data;
+		ContextRef context( index );
+		if ( !context.IsValid() )
 		{
 			ZkClientPrint( ZK_LOG_LVL_KEYSTATUS,"ReserveNodeCreateCB context is null\n" );
+			return;
 		}
 
 		if ( rc == ZOK )
 		{
-			ThreadParam* param = new ThreadParam();
-			param->path_ = value;
-			param->zkhandle_ = context.zkhanlde_;
-			param->auto_delete_time_ = context.auto_delete_time_;
-
-			ZkClientPrint( ZK_LOG_LVL_DETAIL,"auto delete reserve node time=%d path=%s\n", param->auto_delete_time_,value );
-
-			if ( param->auto_delete_time_ != 0 )
-			{
-				pthread_t thd;
-#ifdef WIN32
-				pthread_create( &thd, 0, AutoDeleteReserveNode, param );	
-#else
-				pthread_create( &thd, NULL, AutoDeleteReserveNodeForLinux, param );	
-#endif
-				pthread_detach( thd );					
-			}
-			else
-			{
-				DEL_PTR(param);
-			}
+			context->apply_client_->OnReserveCreated( value, context->auto_delete_time_ );
 		}
 		else
 		{
@@ -0,0 +1,114 @@
+/*
+	л׼ֶιstd::stringʵ֣ vs һβ'\0'
+	Ϊv1ʽСӵԴڵ㵽zkڵޣ1Mvalueֶ̡
+	У
+	g++ -O2 -DTHREADED -I../include -I<zookeeper>/include DeSerializeBench.cpp -lzookeeper_mt -lpthread && ./a.out
+*/
+#include "../source/IZkClient.cpp"
+
+using namespace ZkClient;
+
+// ʵ
+static unsigned OldDeSerialize( const char* buff, int len )
+{
+	std::map<std::string, std::string> values;
+	int str_len = 0;
+	while ( len - str_len > 0 )
+	{
+		std::string key = buff + str_len;
+		str_len += key.length() + 1;
+
+		std::string value = buff + str_len;
+		str_len += value.length() + 1;
+
+		values[key] = value;
+	}
+	return values.size();
+}
+
+// ɴԼsizeֽڵv1ݣvalue[min_len, max_len]֮
+static void MakePayload( unsigned size, unsigned min_len, unsigned max_len, std::vector<char>& payload )
+{
+	NodeValue* value = NodeValue::Create();
+	unsigned total = 0;
+	unsigned seed = 1;
+	for ( unsigned i = 0; total < size; i++ )
+	{
+		char key[32];
+		sprintf( key, "field%06u", i );
+		seed = seed * 1103515245 + 12345;
+		std::string text( min_len + ( seed >> 16 ) % ( max_len - min_len + 1 ), 'a' + i % 26 );
+		value->AddValue( key, text.c_str() );
+		total += strlen( key ) + text.size() + 2;
+	}
+	int len = value->GetSerializedSize( SerializeV1 );
+	payload.resize( len );
+	value->Serialize( &payload[0], len, SerializeV1 );
+	NodeValue::Destory( value );
+}
+
+// MB/s
+static double MeasureOld( const std::vector<char>& payload, unsigned rounds, unsigned& check )
+{
+	unsigned long long begin = GetTimeUs();
+	for ( unsigned i = 0; i < rounds; i++ )
+	{
+		check += OldDeSerialize( &payload[0], payload.size() );
+	}
+	unsigned long long used = GetTimeUs() - begin + 1;
+	return (double)payload.size() * rounds / used;
+}
+
+static double MeasureBuild( const std::vector<char>& payload, unsigned rounds, unsigned& check )
+{
+	FieldEntries entries;
+	unsigned garbage = 0;
+	unsigned long long begin = GetTimeUs();
+	for ( unsigned i = 0; i < rounds; i++ )
+	{
+		FieldIndex::Build( &payload[0], payload.size(), payload.size(), entries, garbage );
+		check += entries.size();
+	}
+	unsigned long long used = GetTimeUs() - begin + 1;
+	return (double)payload.size() * rounds / used;
+}
+
+static double MeasureNodeValue( const std::vector<char>& payload, unsigned rounds, unsigned& check )
+{
+	unsigned long long begin = GetTimeUs();
+	for ( unsigned i = 0; i < rounds; i++ )
+	{
+		NodeValue* value = NodeValue::Create();
+		value->DeSerialize( &payload[0], payload.size() );
+		check += value->GetCount();
+		NodeValue::Destory( value );
+	}
+	unsigned long long used = GetTimeUs() - begin + 1;
+	return (double)payload.size() * rounds / used;
+}
+
+int main()
+{
+	// valueΪԴڵĳݣַصȣvalueΪõĽڵ
+	struct { unsigned size; unsigned min_len; unsigned max_len; } cases[] = {
+		{ 256, 4, 24 }, { 4096, 4, 24 }, { 65536, 4, 24 }, { 1048576, 4, 24 },
+		{ 4096, 200, 800 }, { 65536, 200, 800 }, { 1048576, 200, 800 },
+	};
+	unsigned check = 0;
+	printf( "%8s %9s %12s %12s %12s\n", "bytes", "value_len", "old(MB/s)", "index(MB/s)", "decode(MB/s)" );
+	for ( unsigned c = 0; c < sizeof(cases) / sizeof(cases[0]); c++ )
+	{
+		std::vector<char> payload;
+		MakePayload( cases[c].size, cases[c].min_len, cases[c].max_len, payload );
+		unsigned rounds = 1 + ( 64U << 20 ) / payload.size();
+		char value_len[32];
+		sprintf( value_len, "%u-%u", cases[c].min_len, cases[c].max_len );
+
+		double old_speed = MeasureOld( payload, rounds, check );
+		double index_speed = MeasureBuild( payload, rounds, check );
+		double decode_speed = MeasureNodeValue( payload, rounds, check );
+		printf( "%8u %9s %12.1f %12.1f %12.1f\n", (unsigned)payload.size(), value_len, old_speed, index_speed, decode_speed );
+	}
+	printf( "check=%u\n", check );
+	return 0;
+}
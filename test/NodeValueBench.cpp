@@ -0,0 +1,134 @@
+/*
+	NodeValue洢׼ƽ飨ǰʵ֣ vs std::mapʵ֣
+	ԱӡGetKey/GetValue(index)keyֲ
+	У
+	g++ -O2 -DTHREADED -I../include -I<zookeeper>/include NodeValueBench.cpp -lzookeeper_mt -lpthread && ./a.out
+*/
+#include "../source/IZkClient.cpp"
+
+using namespace ZkClient;
+
+// ʵ֣std::map洢ʱͷƶ
+class MapValue
+{
+public:
+	unsigned GetCount() const{ return values_.size(); }
+	const char* GetKey( unsigned index ) const
+	{
+		if ( index >= values_.size() )
+		{
+			return NULL;
+		}
+		Values::const_iterator itr = values_.begin();
+		while ( index > 0 )
+		{
+			itr++;
+			index--;
+		}
+		return itr->first.c_str();
+	}
+	const char* GetValue( unsigned index ) const
+	{
+		if ( index >= values_.size() )
+		{
+			return NULL;
+		}
+		Values::const_iterator itr = values_.begin();
+		while ( index > 0 )
+		{
+			itr++;
+			index--;
+		}
+		return itr->second.c_str();
+	}
+	const char* GetValue( const char* key ) const
+	{
+		Values::const_iterator itr = values_.find( key );
+		return itr != values_.end() ? itr->second.c_str() : NULL;
+	}
+	void AddValue( const char* key, const char* value ){ values_[key] = value; }
+private:
+	typedef std::map<std::string, std::string> Values;
+	Values values_;
+};
+
+struct BenchResult
+{
+	double add_ns;
+	double scan_ns;
+	double find_ns;
+	unsigned long long check;
+};
+
+// ÿֶεƽʱnscheckڷֹŻ
+template<class T>
+static BenchResult Run( T* (*create)(), void (*destory)( T* ), const std::vector<std::string>& keys, unsigned rounds )
+{
+	BenchResult result = { 0, 0, 0, 0 };
+	unsigned count = keys.size();
+	unsigned long long add_us = 0, scan_us = 0, find_us = 0;
+	for ( unsigned round = 0; round < rounds; round++ )
+	{
+		T* value = create();
+		unsigned long long begin = GetTimeUs();
+		for ( unsigned i = 0; i < count; i++ )
+		{
+			value->AddValue( keys[i].c_str(), "192.168.100.100:5060" );
+		}
+		unsigned long long end = GetTimeUs();
+		add_us += end - begin;
+
+		begin = end;
+		for ( unsigned i = 0; i < value->GetCount(); i++ )
+		{
+			result.check += strlen( value->GetKey( i ) ) + strlen( value->GetValue( i ) );
+		}
+		end = GetTimeUs();
+		scan_us += end - begin;
+
+		begin = end;
+		for ( unsigned i = 0; i < count; i++ )
+		{
+			result.check += value->GetValue( keys[i].c_str() ) != NULL;
+		}
+		end = GetTimeUs();
+		find_us += end - begin;
+		destory( value );
+	}
+	double fields = (double)count * rounds / 1000.0;
+	result.add_ns = add_us / fields;
+	result.scan_ns = scan_us / fields;
+	result.find_ns = find_us / fields;
+	return result;
+}
+
+static MapValue* CreateMap(){ return new MapValue; }
+static void DestoryMap( MapValue* value ){ delete value; }
+
+int main()
+{
+	unsigned counts[] = { 8, 64, 512, 4096 };
+	printf( "%8s %-8s %12s %12s %12s\n", "fields", "store", "add(ns)", "scan(ns)", "find(ns)" );
+	for ( unsigned n = 0; n < sizeof(counts) / sizeof(counts[0]); n++ )
+	{
+		// keyӣԴڵʵʷֲӽ
+		std::vector<std::string> keys;
+		for ( unsigned i = 0; i < counts[n]; i++ )
+		{
+			char key[32];
+			sprintf( key, "Mcu%08u", ( i * 2654435761U ) % 100000000 );
+			keys.push_back( key );
+		}
+		unsigned rounds = 1 + 50000 / counts[n];
+		BenchResult flat = Run( NodeValue::Create, NodeValue::Destory, keys, rounds );
+		BenchResult map = Run( CreateMap, DestoryMap, keys, rounds );
+		if ( flat.check != map.check )
+		{
+			printf( "result mismatch\n" );
+			return 1;
+		}
+		printf( "%8u %-8s %12.1f %12.1f %12.1f\n", counts[n], "flat", flat.add_ns, flat.scan_ns, flat.find_ns );
+		printf( "%8u %-8s %12.1f %12.1f %12.1f\n", counts[n], "map", map.add_ns, map.scan_ns, map.find_ns );
+	}
+	return 0;
+}
@@ -0,0 +1,214 @@
+/*
+	NodeValueлԣstd::mapʵֵĽԱȣ
+	Ҫڲֱ࣬ӰIZkClient.cppУ
+	g++ -DTHREADED -I../include -I<zookeeper>/include NodeValueTest.cpp -lzookeeper_mt -lpthread && ./a.out
+*/
+#include "../source/IZkClient.cpp"
+#include <assert.h>
+
+using namespace ZkClient;
+
+typedef std::map<std::string, std::string> RefValues;
+
+static unsigned g_seed = 12345;
+static unsigned Random()
+{
+	g_seed = g_seed * 1103515245 + 12345;
+	return ( g_seed >> 16 ) & 0x7fff;
+}
+
+static std::string RandomText( unsigned max_len )
+{
+	std::string text;
+	unsigned len = Random() % ( max_len + 1 );
+	for ( unsigned i = 0; i < len; i++ )
+	{
+		text += (char)( 'a' + Random() % 26 );
+	}
+	return text;
+}
+
+// refȫһ£˳򡢳ȡkeyң
+template<class T>
+static void CheckEqual( const T* value, const RefValues& ref )
+{
+	assert( value->GetCount() == ref.size() );
+	unsigned index = 0;
+	for ( RefValues::const_iterator itr = ref.begin(); itr != ref.end(); itr++, index++ )
+	{
+		assert( itr->first == value->GetKey( index ) );
+		assert( value->GetValueLength( index ) == itr->second.size() );
+		assert( memcmp( value->GetValue( index ), itr->second.data(), itr->second.size() ) == 0 );
+		unsigned value_len = 0;
+		const char* text = value->GetValue( itr->first.c_str(), value_len );
+		assert( text != NULL && value_len == itr->second.size() );
+		assert( memcmp( text, itr->second.data(), value_len ) == 0 );
+	}
+	assert( value->GetKey( index ) == NULL );
+	assert( value->GetValue( "no_such_key" ) == NULL );
+}
+
+// ָ汾лֱNodeValueNodeValueViewrefԱ
+static void CheckRoundTrip( const NodeValue* value, const RefValues& ref, int version )
+{
+	int size = value->GetSerializedSize( version );
+	assert( size > 0 );
+	std::vector<char> buff( size );
+	int len = size - 1;
+	assert( !value->Serialize( &buff[0], len, version ) );
+	len = size;
+	assert( value->Serialize( &buff[0], len, version ) && len == size );
+	assert( ( FieldIndex::GetVersion( &buff[0], len ) == SerializeV2 ) == ( version == SerializeV2 ) );
+
+	NodeValue* copy = NodeValue::Create();
+	copy->DeSerialize( &buff[0], len );
+	CheckEqual( copy, ref );
+	assert( copy->GetFingerprint() == value->GetFingerprint() );
+	NodeValue::Destory( copy );
+
+	NodeValueView* view = NodeValueView::Create();
+	assert( view->Attach( &buff[0], len ) );
+	CheckEqual( view, ref );
+	assert( view->GetFingerprint() == value->GetFingerprint() );
+	NodeValueView::Destory( view );
+}
+
+// ɾظkeyvalueָʽ
+static void TestRandom()
+{
+	for ( int round = 0; round < 200; round++ )
+	{
+		RefValues ref;
+		NodeValue* value = NodeValue::Create();
+		unsigned ops = Random() % 300;
+		for ( unsigned i = 0; i < ops; i++ )
+		{
+			char key[32];
+			sprintf( key, "key%u", Random() % 100 );
+			if ( Random() % 8 == 0 )
+			{
+				assert( value->DeleteValue( key ) == ( ref.erase( key ) > 0 ) );
+			}
+			else
+			{
+				std::string text = RandomText( 64 );
+				value->AddValue( key, text.c_str() );
+				ref[key] = text;
+			}
+		}
+		CheckEqual( value, ref );
+		if ( !ref.empty() )
+		{
+			CheckRoundTrip( value, ref, SerializeV1 );
+			CheckRoundTrip( value, ref, SerializeV2 );
+		}
+		NodeValue::Destory( value );
+	}
+}
+
+// valueֻʹv2
+static void TestBinary()
+{
+	RefValues ref;
+	NodeValue* value = NodeValue::Create();
+	value->AddValue( "bin", "x\0y\0", 4 );
+	ref["bin"] = std::string( "x\0y\0", 4 );
+	value->AddValue( "text", "abc" );
+	ref["text"] = "abc";
+	CheckRoundTrip( value, ref, SerializeV2 );
+
+	char buff[256];
+	int len = sizeof(buff);
+	assert( !value->Serialize( buff, len, SerializeV1 ) );
+	len = sizeof(buff);
+	assert( value->Serialize( buff, len ) && FieldIndex::GetVersion( buff, len ) == SerializeV2 );
+	len = -1;
+	assert( !value->Serialize( buff, len, SerializeV1 ) );
+	NodeValue::Destory( value );
+}
+
+// ֵֶΣv1ıv2ͣ߶ٶֵ
+static void TestNumber()
+{
+	NodeValue* value = NodeValue::Create();
+	value->SetInt64( "int", -1234567890123LL );
+	value->SetDouble( "double", 0.5 );
+	value->AddValue( "text", "42" );
+	int versions[] = { SerializeV1, SerializeV2 };
+	for ( int i = 0; i < 2; i++ )
+	{
+		char buff[256];
+		int len = sizeof(buff);
+		assert( value->Serialize( buff, len, versions[i] ) );
+		NodeValue* copy = NodeValue::Create();
+		copy->DeSerialize( buff, len );
+		long long int_value = 0;
+		double double_value = 0;
+		assert( copy->GetInt64( "int", int_value ) && int_value == -1234567890123LL );
+		assert( copy->GetDouble( "double", double_value ) && double_value == 0.5 );
+		assert( copy->GetInt64( "text", int_value ) && int_value == 42 );
+		assert( strcmp( copy->GetValue( "int" ), "-1234567890123" ) == 0 );
+		// v1ʧֵָֻͣv2±һ
+		assert( ( copy->GetFingerprint() == value->GetFingerprint() ) == ( versions[i] == SerializeV2 ) );
+		NodeValue::Destory( copy );
+	}
+	NodeValue::Destory( value );
+}
+
+// ʵֶ֣ιstd::stringĽԱȣǲͬȡ롢'\0'ܶ
+static void TestScan()
+{
+	std::vector<char> data( 512 );
+	unsigned densities[] = { 2, 5, 16, 100 };
+	for ( unsigned len = 1; len < 300; len++ )
+	{
+		for ( unsigned offset = 0; offset < 32; offset += 5 )
+		{
+			unsigned density = densities[Random() % 4];
+			char* buff = &data[offset];
+			unsigned nul_count = 0;
+			for ( unsigned i = 0; i < len; i++ )
+			{
+				buff[i] = ( Random() % density == 0 || i == len - 1 ) ? '\0' : (char)( 'a' + Random() % 26 );
+				nul_count += buff[i] == '\0';
+			}
+
+			FieldEntries entries;
+			unsigned garbage = 0;
+			bool ret = FieldIndex::Build( buff, len, len, entries, garbage );
+			// keyvalue'\0'βʱ
+			assert( ret == ( nul_count % 2 == 0 ) );
+			if ( !ret )
+			{
+				continue;
+			}
+			RefValues ref;
+			unsigned pos = 0;
+			while ( pos < len )
+			{
+				std::string key = buff + pos;
+				pos += key.length() + 1;
+				std::string value = buff + pos;
+				pos += value.length() + 1;
+				ref[key] = value;
+			}
+			assert( entries.size() == ref.size() );
+			unsigned index = 0;
+			for ( RefValues::iterator itr = ref.begin(); itr != ref.end(); itr++, index++ )
+			{
+				assert( itr->first == std::string( buff + entries[index].key_, entries[index].key_len_ ) );
+				assert( itr->second == std::string( buff + entries[index].value_, entries[index].value_len_ ) );
+			}
+		}
+	}
+}
+
+int main()
+{
+	TestRandom();
+	TestBinary();
+	TestNumber();
+	TestScan();
+	printf( "NodeValueTest ok\n" );
+	return 0;
+}